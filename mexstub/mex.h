@@ -0,0 +1,73 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+/*
+ * Minimal stand-in for MATLAB's mex.h, covering only what MyRv64gDecoder.cc
+ * uses, so that the MEX entry point can be built and exercised without
+ * MATLAB. Arrays are column-major and own their storage like the real ones.
+ */
+
+#ifndef mex_h
+#define mex_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+typedef size_t mwSize;
+typedef size_t mwIndex;
+
+enum mxClassID {
+    mxUNKNOWN_CLASS,
+    mxCELL_CLASS,
+    mxCHAR_CLASS,
+    mxDOUBLE_CLASS,
+    mxINT8_CLASS,
+    mxUINT8_CLASS,
+    mxINT16_CLASS,
+    mxUINT16_CLASS,
+    mxINT32_CLASS,
+    mxUINT32_CLASS,
+    mxINT64_CLASS,
+    mxUINT64_CLASS
+};
+
+enum mxComplexity {
+    mxREAL,
+    mxCOMPLEX
+};
+
+struct mxArray {
+    mxClassID class_id;
+    std::vector<mwSize> dims;
+    std::vector<uint8_t> data;
+    std::vector<mxArray*> cells;
+    std::string str;
+};
+
+mxArray *mxCreateDoubleMatrix(mwSize m, mwSize n, mxComplexity complexity);
+mxArray *mxCreateNumericArray(mwSize ndim, const mwSize *dims, mxClassID class_id, mxComplexity complexity);
+mxArray *mxCreateString(const char *str);
+mxArray *mxCreateCellArray(mwSize ndim, const mwSize *dims);
+void mxDestroyArray(mxArray *array);
+
+bool mxIsChar(const mxArray *array);
+bool mxIsUint32(const mxArray *array);
+size_t mxGetNumberOfElements(const mxArray *array);
+mwSize mxGetNumberOfDimensions(const mxArray *array);
+const mwSize *mxGetDimensions(const mxArray *array);
+void *mxGetData(const mxArray *array);
+double *mxGetPr(const mxArray *array);
+int mxGetString(const mxArray *array, char *buf, mwSize buflen);
+void mxSetCell(mxArray *array, mwIndex index, mxArray *value);
+mxArray *mxGetCell(const mxArray *array, mwIndex index);
+
+/* Throws std::runtime_error instead of unwinding back into MATLAB */
+void mexErrMsgIdAndTxt(const char *id, const char *fmt, ...);
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+#endif
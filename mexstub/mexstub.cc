@@ -0,0 +1,120 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mex.h"
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <stdexcept>
+
+static size_t mx_class_size(mxClassID class_id) {
+    switch (class_id) {
+        case mxDOUBLE_CLASS:    return sizeof(double);
+        case mxINT8_CLASS:
+        case mxUINT8_CLASS:     return 1;
+        case mxINT16_CLASS:
+        case mxUINT16_CLASS:    return 2;
+        case mxINT32_CLASS:
+        case mxUINT32_CLASS:    return 4;
+        case mxINT64_CLASS:
+        case mxUINT64_CLASS:    return 8;
+        default:                return 0;
+    }
+}
+
+mxArray *mxCreateNumericArray(mwSize ndim, const mwSize *dims, mxClassID class_id, mxComplexity complexity) {
+    mxArray *array = new mxArray();
+    array->class_id = class_id;
+    array->dims.assign(dims, dims + ndim);
+    array->data.assign(mxGetNumberOfElements(array) * mx_class_size(class_id), 0);
+    return array;
+}
+
+mxArray *mxCreateDoubleMatrix(mwSize m, mwSize n, mxComplexity complexity) {
+    mwSize dims[2] = { m, n };
+    return mxCreateNumericArray(2, dims, mxDOUBLE_CLASS, complexity);
+}
+
+mxArray *mxCreateString(const char *str) {
+    mxArray *array = new mxArray();
+    array->class_id = mxCHAR_CLASS;
+    array->str = str;
+    array->dims = { 1, array->str.size() };
+    return array;
+}
+
+mxArray *mxCreateCellArray(mwSize ndim, const mwSize *dims) {
+    mxArray *array = new mxArray();
+    array->class_id = mxCELL_CLASS;
+    array->dims.assign(dims, dims + ndim);
+    array->cells.assign(mxGetNumberOfElements(array), nullptr);
+    return array;
+}
+
+void mxDestroyArray(mxArray *array) {
+    if (!array)
+        return;
+    for (mxArray *cell : array->cells)
+        mxDestroyArray(cell);
+    delete array;
+}
+
+bool mxIsChar(const mxArray *array) {
+    return array->class_id == mxCHAR_CLASS;
+}
+
+bool mxIsUint32(const mxArray *array) {
+    return array->class_id == mxUINT32_CLASS;
+}
+
+size_t mxGetNumberOfElements(const mxArray *array) {
+    size_t count = 1;
+    for (mwSize dim : array->dims)
+        count *= dim;
+    return count;
+}
+
+mwSize mxGetNumberOfDimensions(const mxArray *array) {
+    return array->dims.size();
+}
+
+const mwSize *mxGetDimensions(const mxArray *array) {
+    return array->dims.data();
+}
+
+void *mxGetData(const mxArray *array) {
+    return (void*)array->data.data();
+}
+
+double *mxGetPr(const mxArray *array) {
+    return (double*)mxGetData(array);
+}
+
+int mxGetString(const mxArray *array, char *buf, mwSize buflen) {
+    if (!mxIsChar(array) || buflen == 0)
+        return 1;
+    strncpy(buf, array->str.c_str(), buflen - 1);
+    buf[buflen - 1] = '\0';
+    return array->str.size() < buflen ? 0 : 1;
+}
+
+void mxSetCell(mxArray *array, mwIndex index, mxArray *value) {
+    mxDestroyArray(array->cells[index]);
+    array->cells[index] = value;
+}
+
+mxArray *mxGetCell(const mxArray *array, mwIndex index) {
+    return array->cells[index];
+}
+
+void mexErrMsgIdAndTxt(const char *id, const char *fmt, ...) {
+    char msg[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    throw std::runtime_error(std::string(id) + ": " + msg);
+}
@@ -0,0 +1,124 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "mex.h"
+#include "riscv-types.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+
+static int failures = 0;
+
+static void check(bool cond, const char *what, size_t i) {
+    if (!cond) {
+        fprintf(stderr, "FAIL %s at %zu\n", what, i);
+        failures++;
+    }
+}
+
+struct expected_decode {
+    uint32_t inst;
+    bool legal;
+    uint16_t op;
+    uint16_t codec;
+    uint8_t rd, rs1, rs2, rs3;
+    int64_t imm;
+    const char *mnemonic;
+};
+
+//Hand-encoded words and the fields batch mode must return for them
+static const expected_decode known_words[] = {
+    { 0x00000013, true,  riscv_op_addi,    riscv_codec_i,       0,  0,  0, 0,    0, "addi"    }, //addi zero,zero,0
+    { 0xfff00093, true,  riscv_op_addi,    riscv_codec_i,       1,  0,  0, 0,   -1, "addi"    }, //addi ra,zero,-1
+    { 0x0000b503, true,  riscv_op_ld,      riscv_codec_i,      10,  1,  0, 0,    0, "ld"      }, //ld a0,0(ra)
+    { 0x00a13423, true,  riscv_op_sd,      riscv_codec_s,       0,  2, 10, 0,    8, "sd"      }, //sd a0,8(sp)
+    { 0x00c58533, true,  riscv_op_add,     riscv_codec_r,      10, 11, 12, 0,    0, "add"     }, //add a0,a1,a2
+    { 0x223170c3, true,  riscv_op_fmadd_d, riscv_codec_r_4,    1,  2,  3, 4,    0, "fmadd.d" }, //fmadd.d f1,f2,f3,f4
+    { 0x008000ef, true,  riscv_op_jal,     riscv_codec_uj,      1,  0,  0, 0,    8, "jal"     }, //jal ra,8
+    { 0xfe000ee3, true,  riscv_op_beq,     riscv_codec_sb,      0,  0,  0, 0,   -4, "beq"     }, //beq zero,zero,-4
+    { 0xffffffff, false, riscv_op_unknown, riscv_codec_unknown, 0,  0,  0, 0,    0, "NA"      },
+    { 0x00000000, false, riscv_op_unknown, riscv_codec_unknown, 0,  0,  0, 0,    0, "NA"      },
+};
+
+//Decodes the known words as a rows x cols matrix through batch mode and checks every output
+static void test_batch(mwSize rows, mwSize cols) {
+    const size_t count = sizeof(known_words) / sizeof(known_words[0]);
+    mwSize dims[2] = { rows, cols };
+    mxArray *in = mxCreateNumericArray(2, dims, mxUINT32_CLASS, mxREAL);
+    uint32_t *insts = (uint32_t*)mxGetData(in);
+    for (size_t i = 0; i < rows * cols; i++)
+        insts[i] = known_words[i % count].inst;
+
+    mxArray *out[9] = { nullptr };
+    const mxArray *prhs[1] = { in };
+    mexFunction(9, out, 1, prhs);
+
+    for (int k = 0; k < 9; k++) {
+        check(mxGetNumberOfDimensions(out[k]) == 2 && mxGetDimensions(out[k])[0] == rows
+            && mxGetDimensions(out[k])[1] == cols, "output shape", k);
+    }
+    const uint8_t *legal = (const uint8_t*)mxGetData(out[0]);
+    const uint16_t *op = (const uint16_t*)mxGetData(out[1]);
+    const uint16_t *codec = (const uint16_t*)mxGetData(out[2]);
+    const uint8_t *rd = (const uint8_t*)mxGetData(out[3]);
+    const uint8_t *rs1 = (const uint8_t*)mxGetData(out[4]);
+    const uint8_t *rs2 = (const uint8_t*)mxGetData(out[5]);
+    const uint8_t *rs3 = (const uint8_t*)mxGetData(out[6]);
+    const int64_t *imm = (const int64_t*)mxGetData(out[7]);
+    for (size_t i = 0; i < rows * cols; i++) {
+        const expected_decode &e = known_words[i % count];
+        check(legal[i] == e.legal, "legal", i);
+        check(op[i] == e.op, "op", i);
+        check(codec[i] == e.codec, "codec", i);
+        check(rd[i] == e.rd && rs1[i] == e.rs1 && rs2[i] == e.rs2 && rs3[i] == e.rs3, "registers", i);
+        check(imm[i] == e.imm, "imm", i);
+        check(strcmp(mxGetCell(out[8], i)->str.c_str(), e.mnemonic) == 0, "mnemonic", i);
+    }
+
+    for (int k = 0; k < 9; k++)
+        mxDestroyArray(out[k]);
+    mxDestroyArray(in);
+}
+
+static void test_string() {
+    mxArray *in = mxCreateString("00c58533");
+    mxArray *out[2] = { nullptr };
+    const mxArray *prhs[1] = { in };
+    mexFunction(2, out, 1, prhs);
+    check(*mxGetPr(out[0]) == 0, "string retval", 0);
+    check(out[1]->str.find("Mneumonic: add\n") != std::string::npos, "string output", 0);
+    mxDestroyArray(out[0]);
+    mxDestroyArray(out[1]);
+    mxDestroyArray(in);
+}
+
+static void test_errors() {
+    mxArray *in = mxCreateDoubleMatrix(1, 1, mxREAL);
+    mxArray *out[1] = { nullptr };
+    const mxArray *prhs[1] = { in };
+    bool thrown = false;
+    try {
+        mexFunction(1, out, 1, prhs);
+    } catch (std::runtime_error &e) {
+        thrown = true;
+    }
+    check(thrown, "double input rejected", 0);
+    mxDestroyArray(in);
+}
+
+int main(int argc, const char *argv[])
+{
+    test_batch(2, 5);
+    test_batch(1000, 3);
+
+    test_string();
+    test_errors();
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -9,10 +9,69 @@
 #include "mex.h"
 #include "mwg_decode.h"
 
+/*
+ * Batch mode: [legal, op, codec, rd, rs1, rs2, rs3, imm, mnemonics] = MyRv64gDecoder(insts)
+ * where insts is a uint32 array. Every numeric output has the shape of insts
+ * (legal/rd/rs1/rs2/rs3 uint8, op/codec uint16, imm int64) and holds the raw
+ * decode fields. The mnemonic cell array is only built when it is requested.
+ */
+static void mwg_mex_batch(int nlhs, mxArray *plhs[], const mxArray *insts) {
+    mwSize ndims = mxGetNumberOfDimensions(insts);
+    const mwSize *dims = mxGetDimensions(insts);
+    size_t count = mxGetNumberOfElements(insts);
+
+    mxClassID classes[8] = {
+        mxUINT8_CLASS, mxUINT16_CLASS, mxUINT16_CLASS,
+        mxUINT8_CLASS, mxUINT8_CLASS, mxUINT8_CLASS, mxUINT8_CLASS, mxINT64_CLASS
+    };
+    mxArray *outputs[8];
+    for (int i = 0; i < 8; i++)
+        outputs[i] = mxCreateNumericArray(ndims, dims, classes[i], mxREAL);
+
+    //Decode straight into the MATLAB arrays
+    mwg_batch_fields fields;
+    fields.legal = (uint8_t*)mxGetData(outputs[0]);
+    fields.op = (uint16_t*)mxGetData(outputs[1]);
+    fields.codec = (uint16_t*)mxGetData(outputs[2]);
+    fields.rd = (uint8_t*)mxGetData(outputs[3]);
+    fields.rs1 = (uint8_t*)mxGetData(outputs[4]);
+    fields.rs2 = (uint8_t*)mxGetData(outputs[5]);
+    fields.rs3 = (uint8_t*)mxGetData(outputs[6]);
+    fields.imm = (int64_t*)mxGetData(outputs[7]);
+    fields.arg = NULL;
+    mwg_decode_batch((const uint32_t*)mxGetData(insts), count, fields);
+
+    for (int i = 0; i < 8; i++) {
+        if (i < nlhs || i == 0)
+            plhs[i] = outputs[i];
+        else
+            mxDestroyArray(outputs[i]);
+    }
+
+    if (nlhs > 8) {
+        plhs[8] = mxCreateCellArray(ndims, dims);
+        for (size_t i = 0; i < count; i++)
+            mxSetCell(plhs[8], i, mxCreateString(fields.legal[i] ? mwg_op_name(fields.op[i]) : "NA"));
+    }
+}
+
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    if (nrhs != 1)
+        mexErrMsgIdAndTxt("MyRv64gDecoder:nrhs", "Expected one input: an 8-character hex string or a uint32 array.");
+
+    if (mxIsUint32(prhs[0])) {
+        if (nlhs > 9)
+            mexErrMsgIdAndTxt("MyRv64gDecoder:nlhs", "Batch mode has at most 9 outputs.");
+        mwg_mex_batch(nlhs, plhs, prhs[0]);
+        return;
+    }
+
+    if (!mxIsChar(prhs[0]))
+        mexErrMsgIdAndTxt("MyRv64gDecoder:type", "Input must be an 8-character hex string or a uint32 array.");
+
     //redirect stdout
     std::stringstream outputStream;
-    std::cout.rdbuf(outputStream.rdbuf()); 
+    std::streambuf *coutBuf = std::cout.rdbuf(outputStream.rdbuf());
 
     //Get raw input
     char inputCharString[9];
@@ -21,6 +80,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     std::string instString(inputCharString);
 
     int retval = mwg_decode(instString);
+    std::cout.rdbuf(coutBuf);
 
     double* output = NULL;
     plhs[0] = mxCreateDoubleMatrix(1,1,mxREAL);
@@ -3,20 +3,344 @@
  * Email: mgottscho@ucla.edu
  */
 
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
 #include <string>
+#include <vector>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <atomic>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "riscv-cmdline.h"
 #include "mwg_decode.h"
+#include "mwg_legal_bitmap.h"
+#include "mwg_census.h"
+#include "mwg_stream.h"
+#include "mwg_text.h"
+#include "mwg_disasm.h"
+#include "mwg_sdecc.h"
+#include "mwg_sdecc_driver.h"
+#include "mwg_corpus.h"
+
+//Parses a 32-bit hex word, rejecting anything that is not entirely hex digits or does not fit
+static bool parse_hex32(const char *s, uint32_t *value) {
+    if (!isxdigit((unsigned char)s[0]))
+        return false;
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 16);
+    if (*end != '\0' || errno == ERANGE || v > 0xffffffffULL)
+        return false;
+    *value = uint32_t(v);
+    return true;
+}
 
 int main(int argc, const char *argv[])
 {
-    if (argc != 2) {
-        std::cout << "Usage: riscvdecode <INST>" << std::endl;
+    std::string gen_filename;
+    std::string bitmap_filename;
+    unsigned num_threads = 0;
+    bool census = false;
+    bool stream = false;
+    size_t cache_entries = 0;
+    bool blob = false;
+    bool elf = false;
+    bool disasm = false;
+    std::string fetch_filename;
+    std::string corpus_filename;
+    bool corpus_merge = false;
+    std::string isa;
+    std::string sdecc_received;
+    std::string sdecc_events_filename;
+    std::string parity_check_filename;
+    unsigned code_n = 39, code_k = 32;
+    std::string census_ops_filename;
+    uint32_t fixed_mask = 0, fixed_value = 0;
+    bool help = false;
+
+    cmdline_option options[] = {
+        { "-g", "--gen-legal-bitmap", cmdline_arg_type_string,
+            "Write the RV64G legality bitmap of all 2^32 words to this file",
+            [&](std::string s) { gen_filename = s; return true; } },
+        { "-t", "--threads", cmdline_arg_type_int,
+            "Worker threads for --gen-legal-bitmap, --census, --sdecc-events, --disasm and --corpus (default: one per core)",
+            [&](std::string s) { num_threads = strtoul(s.c_str(), nullptr, 0); return true; } },
+        { "-b", "--legal-bitmap", cmdline_arg_type_string,
+            "Look up <INST> in a legality bitmap instead of decoding it",
+            [&](std::string s) { bitmap_filename = s; return true; } },
+        { "-c", "--census", cmdline_arg_type_none,
+            "Count every op and codec over the word space",
+            [&](std::string s) { return (census = true); } },
+        { "-i", "--isa", cmdline_arg_type_string,
+            "ISA profile for every mode, e.g. rv64gc or RV32IMAC (default: rv64g, rv64gc for --blob, ELF class for --elf)",
+            [&](std::string s) {
+                isa = s;
+                if (mwg_decode_select_isa(s.c_str()) == 0)
+                    return true;
+                fprintf(stderr, "unsupported ISA profile: %s (one of %s)\n", s.c_str(), mwg_decode_isa_names().c_str());
+                return false;
+            } },
+        { "-m", "--fixed-mask", cmdline_arg_type_hex,
+            "Restrict --census to words matching --fixed-value under this mask",
+            [&](std::string s) { return parse_hex32(s.c_str(), &fixed_mask); } },
+        { "-v", "--fixed-value", cmdline_arg_type_hex,
+            "Value of the fixed bits for --census",
+            [&](std::string s) { return parse_hex32(s.c_str(), &fixed_value); } },
+        { "-o", "--census-ops", cmdline_arg_type_string,
+            "Write the op id of every visited word (uint16_t, in word order) to this file",
+            [&](std::string s) { census_ops_filename = s; return true; } },
+        { "-s", "--stream", cmdline_arg_type_none,
+            "Decode newline-separated hex words from the given files (or stdin), one record per line",
+            [&](std::string s) { return (stream = true); } },
+        { "-C", "--decode-cache", cmdline_arg_type_int,
+            "Memoize decodes in a per-thread cache of this many words, reporting hits and misses for --stream",
+            [&](std::string s) { cache_entries = strtoull(s.c_str(), nullptr, 0); return true; } },
+        { "-x", "--blob", cmdline_arg_type_none,
+            "Print instruction statistics of the given raw little-endian instruction files",
+            [&](std::string s) { return (blob = true); } },
+        { "-e", "--elf", cmdline_arg_type_none,
+            "Print instruction statistics of the executable sections of the given ELF files",
+            [&](std::string s) { return (elf = true); } },
+        { "-D", "--disasm", cmdline_arg_type_none,
+            "Disassemble the executable sections of the given ELF files, split at symbols across --threads workers",
+            [&](std::string s) { return (disasm = true); } },
+        { "-F", "--fetch", cmdline_arg_type_string,
+            "Print the instruction at each given hex guest address of this ELF's PT_LOAD segments",
+            [&](std::string s) { fetch_filename = s; return true; } },
+        { "-I", "--corpus", cmdline_arg_type_string,
+            "Index the RISC-V ELFs under the given directories into this histogram file, skipping unchanged binaries",
+            [&](std::string s) { corpus_filename = s; return true; } },
+        { "-M", "--corpus-merge", cmdline_arg_type_none,
+            "With --corpus, merge the given histogram files into it instead of scanning directories",
+            [&](std::string s) { return (corpus_merge = true); } },
+        { "-d", "--sdecc", cmdline_arg_type_string,
+            "List the legal candidate messages of this received SECDED codeword (hex)",
+            [&](std::string s) { sdecc_received = s; return true; } },
+        { "-E", "--sdecc-events", cmdline_arg_type_string,
+            "Run --sdecc over a file of '<address> <codeword>' lines, writing results in input order",
+            [&](std::string s) { sdecc_events_filename = s; return true; } },
+        { "-k", "--code", cmdline_arg_type_string,
+            "SECDED code for --sdecc and --sdecc-events: 39,32 (default) or 72,64",
+            [&](std::string s) { return sscanf(s.c_str(), "%u,%u", &code_n, &code_k) == 2; } },
+        { "-H", "--parity-check", cmdline_arg_type_string,
+            "Parity-check matrix for --sdecc as rows of 0/1 (default: Hsiao construction)",
+            [&](std::string s) { parity_check_filename = s; return true; } },
+        { "-h", "--help", cmdline_arg_type_none,
+            "Show help",
+            [&](std::string s) { return (help = true); } },
+        { nullptr, nullptr, cmdline_arg_type_none, nullptr, nullptr }
+    };
+
+    auto result = cmdline_option::process_options(options, argc, argv);
+    bool gen = gen_filename.size() > 0;
+    bool fetch = fetch_filename.size() > 0;
+    bool corpus = corpus_filename.size() > 0;
+    bool files = stream || blob || elf || disasm || fetch || corpus;
+    bool sdecc = sdecc_received.size() > 0;
+    bool sdecc_events = sdecc_events_filename.size() > 0;
+    if (!result.second || help || (!files && result.first.size() != (gen || census || sdecc || sdecc_events ? 0 : 1))
+            || ((blob || elf || disasm || fetch || corpus) && result.first.size() == 0)
+            || (corpus_merge && !corpus)) {
+        std::cout << "Usage: riscvdecode [options] <INST>" << std::endl;
+        std::cout << "       riscvdecode --stream [--decode-cache <N>] [<FILE> ...]" << std::endl;
+        std::cout << "       riscvdecode --blob|--elf [--isa <ISA>] <FILE> ..." << std::endl;
+        std::cout << "       riscvdecode --disasm [--isa <ISA>] [--threads <N>] <FILE> ..." << std::endl;
+        std::cout << "       riscvdecode --fetch <FILE> [--isa <ISA>] <ADDR> ..." << std::endl;
+        std::cout << "       riscvdecode --corpus <FILE> [--threads <N>] <DIR> ..." << std::endl;
+        std::cout << "       riscvdecode --corpus <FILE> --corpus-merge <FILE> ..." << std::endl;
+        std::cout << "       riscvdecode --sdecc <HEX> [--code 39,32|72,64] [--parity-check <FILE>]" << std::endl;
+        std::cout << "       riscvdecode --sdecc-events <FILE> [--code 39,32|72,64] [--parity-check <FILE>]" << std::endl;
+        std::cout << "       riscvdecode --census [--isa <ISA>] [--fixed-mask <HEX> --fixed-value <HEX>]" << std::endl;
         std::cout << "where <INST> is a 32-bit RV64G instruction specified in BIG-ENDIAN hexadecimal format, DEADBEEF -- do not include the 0x or 0h prefix." << std::endl;
-        return 1;
+        cmdline_option::print_options(options);
+        return help ? 0 : 1;
+    }
+
+    if (gen)
+        return mwg_legal_bitmap_generate(gen_filename.c_str(), num_threads);
+
+    mwg_decode_set_cache(cache_entries);
+
+    if (stream) {
+        mwg_out_buffer out(STDOUT_FILENO);
+        uint64_t num_bad = 0;
+        if (result.first.size() == 0)
+            result.first.push_back("-");
+        for (auto &filename : result.first) {
+            int fd = (filename == "-") ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                perror(filename.c_str());
+                num_bad++;
+                continue;
+            }
+            mwg_stream_decode(fd, filename == "-" ? "<stdin>" : filename.c_str(), out, &num_bad);
+            if (fd != STDIN_FILENO)
+                close(fd);
+        }
+        out.flush();
+        if (cache_entries > 0) {
+            uint64_t hits, misses;
+            mwg_decode_cache_stats(&hits, &misses);
+            fprintf(stderr, "decode cache hits %llu misses %llu\n", (unsigned long long)hits, (unsigned long long)misses);
+        }
+        return (num_bad > 0 || out.error) ? 1 : 0;
+    }
+
+    mwg_secded_code code;
+    if (sdecc || sdecc_events) {
+        int status = parity_check_filename.size() > 0
+            ? mwg_secded_load(&code, parity_check_filename.c_str(), code_n, code_k)
+            : mwg_secded_hsiao(&code, code_n, code_k);
+        if (status != 0)
+            return status;
+    }
+
+    if (sdecc_events) {
+        mwg_sdecc_driver_stats stats;
+        int retval = mwg_sdecc_run_events(code, sdecc_events_filename.c_str(), STDOUT_FILENO, num_threads, &stats);
+        fprintf(stderr, "events %llu bad %llu\n", (unsigned long long)stats.num_events, (unsigned long long)stats.num_bad);
+        return (retval != 0 || stats.num_bad > 0) ? 1 : 0;
+    }
+
+    if (sdecc) {
+        mwg_codeword received;
+        if (mwg_codeword_parse(sdecc_received.c_str(), &received) != 0
+                || (code_n < 128 && (received.w[code_n >> 6] >> (code_n & 63)) != 0)
+                || (code_n < 64 && received.w[1] != 0)) {
+            fprintf(stderr, "error received codeword is not %u-bit hex: %s\n", code_n, sdecc_received.c_str());
+            return 1;
+        }
+
+        std::vector<mwg_sdecc_candidate> candidates;
+        size_t num_candidates = mwg_sdecc_candidates(code, received, &candidates);
+        printf("candidates %zu legal %zu\n", num_candidates, candidates.size());
+        for (auto &c : candidates) {
+            char codeword[33];
+            mwg_codeword_format(c.codeword, code_n, codeword);
+            printf("%s %0*llx %u", codeword, int(code_k / 4), (unsigned long long)c.message, c.distance);
+            for (unsigned i = 0; i < c.num_insts; i++) {
+                const mwg_result &r = c.insts[i];
+                printf(" %s %s %s %s", r.mnemonic, r.rd_name ? r.rd_name : "NA",
+                    r.rs1_name ? r.rs1_name : "NA", r.rs2_name ? r.rs2_name : "NA");
+                if (r.has_imm)
+                    printf(" 0x%llx", (unsigned long long)r.imm);
+                else
+                    printf(" NA");
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+
+    if (disasm) {
+        int retval = 0;
+        for (auto &filename : result.first) {
+            mwg_disasm_stats stats;
+            if (mwg_disasm_elf(filename.c_str(), isa.c_str(), STDOUT_FILENO, num_threads, &stats) != 0)
+                retval = 1;
+        }
+        return retval;
+    }
+
+    if (corpus) {
+        mwg_corpus_index index;
+        if (mwg_corpus_load(corpus_filename.c_str(), &index) != 0)
+            return 1;
+        if (corpus_merge) {
+            for (auto &filename : result.first) {
+                mwg_corpus_index other;
+                if (mwg_corpus_load(filename.c_str(), &other) != 0)
+                    return 1;
+                mwg_corpus_merge(&index, other);
+            }
+        } else {
+            std::vector<const char*> dirs;
+            for (auto &dir : result.first)
+                dirs.push_back(dir.c_str());
+            mwg_corpus_stats stats;
+            mwg_corpus_scan(dirs.data(), dirs.size(), num_threads, &index, &stats);
+            fprintf(stderr, "binaries %llu indexed %llu cached %llu insts %llu skipped %llu removed %llu\n",
+                (unsigned long long)stats.num_binaries, (unsigned long long)stats.num_indexed, (unsigned long long)stats.num_cached,
+                (unsigned long long)stats.num_insts, (unsigned long long)stats.num_skipped, (unsigned long long)stats.num_removed);
+        }
+        printf("entries %zu insts %llu\n", index.entries.size(), (unsigned long long)index.total.num_insts);
+        return mwg_corpus_save(corpus_filename.c_str(), index);
+    }
+
+    if (fetch) {
+        std::vector<const char*> addrs;
+        for (auto &addr : result.first)
+            addrs.push_back(addr.c_str());
+        return mwg_text_fetch(fetch_filename.c_str(), isa.c_str(), addrs.data(), addrs.size(), stdout);
+    }
+
+    if (blob || elf) {
+        int retval = 0;
+        mwg_census_decode_fn decode = mwg_census_isa_decoder(isa.size() > 0 ? isa.c_str() : (blob ? "rv64gc" : ""));
+        for (auto &filename : result.first) {
+            mwg_text_stats stats;
+            int status = blob ? mwg_text_decode_blob(filename.c_str(), decode, &stats)
+                              : mwg_text_decode_elf(filename.c_str(), decode, &stats);
+            if (status != 0) {
+                retval = status;
+                continue;
+            }
+            printf("file %s\n", filename.c_str());
+            mwg_text_print(stats, stdout);
+        }
+        return retval;
+    }
+
+    if (census) {
+        mwg_census_config config;
+        config.fixed_mask = fixed_mask;
+        config.fixed_value = fixed_value;
+        config.num_threads = num_threads;
+        config.decode = mwg_census_isa_decoder(isa.size() > 0 ? isa.c_str() : "rv64g");
+        int fd = -1;
+        std::atomic<bool> ops_failed(false);
+        if (census_ops_filename.size() > 0) {
+            fd = open(census_ops_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                perror(census_ops_filename.c_str());
+                return 1;
+            }
+            config.block_fn = [fd, &ops_failed, &census_ops_filename](uint64_t block, const uint32_t *words, const uint16_t *ops, size_t count) {
+                off_t offset = off_t(block) * count * sizeof(uint16_t);
+                if (pwrite(fd, ops, count * sizeof(uint16_t), offset) != ssize_t(count * sizeof(uint16_t))
+                        && !ops_failed.exchange(true))
+                    perror(census_ops_filename.c_str());
+            };
+        }
+        mwg_census_result census_result;
+        int retval = mwg_census_run(config, &census_result);
+        if (fd >= 0 && close(fd) != 0 && !ops_failed.exchange(true))
+            perror(census_ops_filename.c_str());
+        if (ops_failed)
+            retval = 1;
+        if (retval == 0)
+            mwg_census_print(census_result, stdout);
+        return retval;
     }
 
     //Get raw input
-    std::string instString(argv[1]);
+    std::string instString(result.first[0]);
+
+    if (bitmap_filename.size() > 0) {
+        mwg_legal_bitmap bitmap;
+        if (mwg_legal_bitmap_open(bitmap_filename.c_str(), &bitmap) != 0)
+            return 1;
+        uint32_t raw = strtoul(instString.c_str(), nullptr, 16);
+        std::cout << "Legality: " << (bitmap.legal(raw) ? 1 : 0) << std::endl;
+        mwg_legal_bitmap_close(&bitmap);
+        return 0;
+    }
+
     return mwg_decode(instString);
 }
@@ -0,0 +1,463 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-elf.h"
+#include "riscv-elf-file.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-decode-table.h"
+#include "riscv-profile.h"
+#include "riscv-decode-cache.h"
+#include "riscv-classify.h"
+#include "riscv-csr.h"
+#include "riscv-disasm.h"
+#include "riscv-cmdline.h"
+#include "mwg_decode.h"
+#include "mwg_disasm.h"
+
+struct mwg_bench_result {
+    size_t count;
+    double ns_per_inst;
+    uint64_t checksum;
+};
+
+struct mwg_bench_record {
+    std::string words;
+    std::string isa;
+    std::string stage;
+    mwg_bench_result result;
+};
+
+//Every measurement, for --json
+static std::vector<mwg_bench_record> mwg_bench_records;
+static bool mwg_bench_json = false;
+
+//Times step(i) for i in [0, count). Summing what step returns keeps the loop alive and lets backends be compared.
+template <typename F>
+static mwg_bench_result mwg_bench_time(size_t count, F step) {
+    mwg_bench_result result = { count, 0, 0 };
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++)
+        result.checksum = result.checksum * 31 + step(i);
+    auto end = std::chrono::steady_clock::now();
+    result.ns_per_inst = std::chrono::duration<double, std::nano>(end - start).count() / count;
+    return result;
+}
+
+//Times one pass of decode over insts with an op checksum
+template <typename F>
+static mwg_bench_result mwg_bench_run(const std::vector<riscv_lu> &insts, F decode) {
+    return mwg_bench_time(insts.size(), [&](size_t i) {
+        riscv_decode dec = riscv_decode();
+        decode(dec, insts[i]);
+        return riscv_lu(dec.op);
+    });
+}
+
+static void mwg_bench_print(const char *words, const char *isa, const char *stage, mwg_bench_result r) {
+    mwg_bench_records.push_back(mwg_bench_record{ words, isa, stage, r });
+    if (mwg_bench_json)
+        return;
+    printf("%-8s %-8s %-18s %8.3f ns/inst %10.2f Minst/s  checksum %016llx\n",
+        words, isa, stage, r.ns_per_inst, 1e3 / r.ns_per_inst, (unsigned long long)r.checksum);
+}
+
+static void mwg_bench_print_json(size_t count, bool agree) {
+    printf("{\n  \"benchmark\": \"rv64gbench\",\n  \"count\": %zu,\n  \"agree\": %s,\n  \"results\": [",
+        count, agree ? "true" : "false");
+    for (size_t i = 0; i < mwg_bench_records.size(); i++) {
+        const mwg_bench_record &rec = mwg_bench_records[i];
+        printf("%s\n    { \"words\": \"%s\", \"isa\": \"%s\", \"stage\": \"%s\", \"count\": %zu, "
+            "\"ns_per_inst\": %.3f, \"minst_per_s\": %.2f, \"checksum\": \"%016llx\" }",
+            i > 0 ? "," : "", rec.words.c_str(), rec.isa.c_str(), rec.stage.c_str(), rec.result.count,
+            rec.result.ns_per_inst, 1e3 / rec.result.ns_per_inst, (unsigned long long)rec.result.checksum);
+    }
+    printf("\n  ]\n}\n");
+}
+
+//Points stdout at /dev/null while the printing stages run, so the terminal is not timed
+struct mwg_bench_quiet {
+    int saved_fd;
+
+    mwg_bench_quiet() {
+        fflush(stdout);
+        saved_fd = dup(STDOUT_FILENO);
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+
+    ~mwg_bench_quiet() {
+        std::cout.flush();
+        fflush(stdout);
+        dup2(saved_fd, STDOUT_FILENO);
+        close(saved_fd);
+    }
+};
+
+//Times each decoder stage on its own, feeding it the output of the stages before it
+static void mwg_bench_stages(const char *words, const std::vector<riscv_lu> &insts, size_t slow_count) {
+    size_t count = insts.size();
+    std::vector<riscv_decode> opcode(count), type(count), full(count);
+
+    mwg_bench_print(words, "rv64gc", "decode_opcode", mwg_bench_time(count, [&](size_t i) {
+        opcode[i] = riscv_decode();
+        riscv_decode_opcode<riscv_decode,riscv_profile_rv64gc>(opcode[i], insts[i]);
+        return riscv_lu(opcode[i].op);
+    }));
+    mwg_bench_print(words, "rv64gc", "decode_type", mwg_bench_time(count, [&](size_t i) {
+        type[i] = opcode[i];
+        riscv_decode_type(type[i], insts[i]);
+        return riscv_lu(type[i].imm) + type[i].rd + type[i].rs1 + type[i].rs2;
+    }));
+    mwg_bench_print(words, "rv64gc", "decode_decompress", mwg_bench_time(count, [&](size_t i) {
+        full[i] = type[i];
+        riscv_decode_decompress(full[i]);
+        return riscv_lu(full[i].op);
+    }));
+    mwg_bench_print(words, "rv64gc", "encode", mwg_bench_time(count, [&](size_t i) {
+        riscv_decode dec = full[i];
+        return riscv_encode(dec);
+    }));
+    mwg_bench_print(words, "rv64gc", "encode_compress", mwg_bench_time(count, [&](size_t i) {
+        riscv_decode dec = full[i];
+        riscv_encode_compress(dec);
+        return riscv_lu(dec.op);
+    }));
+
+    //The printing stages are much slower, so they only see the first slow_count words
+    size_t slow = std::min(count, slow_count);
+    std::vector<std::string> hex(slow);
+    for (size_t i = 0; i < slow; i++) {
+        char buf[9];
+        snprintf(buf, sizeof(buf), "%08x", uint32_t(insts[i]));
+        hex[i] = buf;
+    }
+    mwg_bench_result disasm, disasm_buf, disasm_null, decode, decode_word;
+    {
+        mwg_bench_quiet quiet;
+        riscv_disasm_history dec_hist;
+        disasm = mwg_bench_time(slow, [&](size_t i) {
+            riscv_disasm dec;
+            static_cast<riscv_decode&>(dec) = full[i];
+            dec.pc = riscv_ptr(i * 4);
+            dec.inst = insts[i];
+            riscv_disasm_instruction(dec, dec_hist, dec.pc, dec.pc + riscv_get_instruction_length(dec.inst), 0, 0);
+            return riscv_lu(dec.op);
+        });
+        decode = mwg_bench_time(slow, [&](size_t i) { return riscv_lu(mwg_decode(hex[i])); });
+    }
+    {
+        riscv_disasm_history dec_hist;
+        char line[256];
+        disasm_buf = mwg_bench_time(slow, [&](size_t i) {
+            riscv_disasm dec;
+            static_cast<riscv_decode&>(dec) = full[i];
+            dec.pc = riscv_ptr(i * 4);
+            dec.inst = insts[i];
+            return riscv_lu(riscv_disasm_instruction(line, sizeof(line), dec, dec_hist,
+                dec.pc, dec.pc + riscv_get_instruction_length(dec.inst), 0, 0));
+        });
+        disasm_null = mwg_bench_time(slow, [&](size_t i) {
+            riscv_disasm dec;
+            static_cast<riscv_decode&>(dec) = full[i];
+            dec.pc = riscv_ptr(i * 4);
+            dec.inst = insts[i];
+            return riscv_lu(riscv_disasm_instruction(line, sizeof(line), dec, dec_hist,
+                dec.pc, dec.pc + riscv_get_instruction_length(dec.inst), 0, 0, riscv_disasm_null_policy()));
+        });
+    }
+    decode_word = mwg_bench_time(count, [&](size_t i) {
+        mwg_result r;
+        mwg_decode_word(uint32_t(insts[i]), &r);
+        return riscv_lu(r.op);
+    });
+    mwg_bench_print(words, "rv64gc", "disasm_instruction", disasm);
+    mwg_bench_print(words, "rv64gc", "disasm_buffer", disasm_buf);
+    mwg_bench_print(words, "rv64gc", "disasm_null_policy", disasm_null);
+    mwg_bench_print(words, "rv64g", "mwg_decode", decode);
+    mwg_bench_print(words, "rv64g", "mwg_decode_word", decode_word);
+}
+
+//riscv_opcode_rules is a copy of the riscv-meta mask/match pairs; a regenerated riscv-meta.cc must not drift from it
+static bool mwg_bench_check_rules() {
+    std::vector<bool> seen(riscv_op_c_sdsp + 1, false);
+    bool agree = true;
+    for (auto &rule : riscv_opcode_rules) {
+        seen[rule.op] = true;
+        if (rule.mask != riscv_instruction_mask[rule.op] || rule.match != riscv_instruction_match[rule.op]) {
+            fprintf(stderr, "riscv_opcode_rules: %s is 0x%08x/0x%08x, riscv-meta has 0x%08x/0x%08x\n",
+                riscv_instruction_name[rule.op], rule.mask, rule.match,
+                riscv_instruction_mask[rule.op], riscv_instruction_match[rule.op]);
+            agree = false;
+        }
+    }
+    for (size_t op = riscv_op_unknown + 1; op < seen.size(); op++) {
+        if (!seen[op]) {
+            fprintf(stderr, "riscv_opcode_rules: no rule for %s\n", riscv_instruction_name[op]);
+            agree = false;
+        }
+    }
+    return agree;
+}
+
+template <typename P>
+static bool mwg_bench_compare_backends(const char *words, const char *isa, const std::vector<riscv_lu> &insts) {
+    mwg_bench_result sw = mwg_bench_run(insts, [](riscv_decode &dec, riscv_lu inst) {
+        riscv_decode_opcode<riscv_decode,P>(dec, inst);
+    });
+    mwg_bench_result tab = mwg_bench_run(insts, [](riscv_decode &dec, riscv_lu inst) {
+        riscv_decode_opcode_table<riscv_decode,P>(dec, inst);
+    });
+    mwg_bench_print(words, isa, "switch", sw);
+    mwg_bench_print(words, isa, "table", tab);
+    if (sw.checksum != tab.checksum) {
+        fprintf(stderr, "%s %s: switch and table backends disagree\n", words, isa);
+        return false;
+    }
+    return true;
+}
+
+//Times every SIMD level the host supports and checks each against scalar riscv_decode_opcode
+static bool mwg_bench_classify(const char *words, const std::vector<riscv_lu> &insts) {
+    std::vector<riscv_wu> raw(insts.begin(), insts.end());
+    std::vector<riscv_bu> legal(raw.size()), codec(raw.size());
+    std::vector<riscv_bu> expect_legal(raw.size()), expect_codec(raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        riscv_decode dec = riscv_decode();
+        riscv_decode_opcode<riscv_decode,riscv_profile_rv64g>(dec, raw[i]);
+        expect_legal[i] = dec.op != riscv_op_unknown;
+        expect_codec[i] = riscv_instruction_codec[dec.op];
+    }
+
+    bool agree = true;
+    for (int level = riscv_simd_detect(); level >= riscv_simd_scalar; level--) {
+        riscv_classify_fn classify = riscv_classify_rv64g_kernel(riscv_simd_level(level));
+        auto start = std::chrono::steady_clock::now();
+        classify(raw.data(), raw.size(), legal.data(), codec.data());
+        auto end = std::chrono::steady_clock::now();
+        mwg_bench_result r = { raw.size(), std::chrono::duration<double, std::nano>(end - start).count() / raw.size(), 0 };
+        for (size_t i = 0; i < raw.size(); i++)
+            r.checksum = r.checksum * 31 + codec[i];
+        mwg_bench_print(words, "rv64g", (std::string("classify_") + riscv_simd_level_name(riscv_simd_level(level))).c_str(), r);
+        if (legal != expect_legal || codec != expect_codec) {
+            fprintf(stderr, "%s %s: classifier disagrees with riscv_decode_opcode\n",
+                words, riscv_simd_level_name(riscv_simd_level(level)));
+            agree = false;
+        }
+    }
+    return agree;
+}
+
+//Disassembles a whole ELF on 1 and on several threads and checks the outputs are identical
+static bool mwg_bench_disasm_threads(const char *words, const char *filename) {
+    const unsigned threads[] = { 1, 3, 7 };
+    std::string outputs[3];
+    for (int k = 0; k < 3; k++) {
+        FILE *file = tmpfile();
+        if (!file) {
+            perror("tmpfile");
+            return false;
+        }
+        mwg_disasm_stats stats;
+        auto start = std::chrono::steady_clock::now();
+        int retval = mwg_disasm_elf(filename, nullptr, fileno(file), threads[k], &stats);
+        auto end = std::chrono::steady_clock::now();
+        rewind(file);
+        char chunk[1 << 16];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+            outputs[k].append(chunk, n);
+        fclose(file);
+        if (retval != 0)
+            return false;
+
+        mwg_bench_result r = { stats.num_insts, std::chrono::duration<double, std::nano>(end - start).count() / std::max<uint64_t>(1, stats.num_insts), 0 };
+        for (char c : outputs[k])
+            r.checksum = r.checksum * 31 + uint8_t(c);
+        char stage[32];
+        snprintf(stage, sizeof(stage), "disasm_elf_%ut", threads[k]);
+        mwg_bench_print(words, "elf", stage, r);
+        if (outputs[k] != outputs[0]) {
+            fprintf(stderr, "%s: disassembly on %u threads differs from 1 thread\n", filename, threads[k]);
+            return false;
+        }
+    }
+    return true;
+}
+
+//Replays a trace drawn Zipf-like from distinct words, decoding each word cold and through a decode cache
+static bool mwg_bench_trace(const char *words, const std::vector<riscv_lu> &distinct, size_t count, size_t cache_entries) {
+    std::vector<double> weights(distinct.size());
+    for (size_t i = 0; i < weights.size(); i++)
+        weights[i] = 1.0 / (i + 1);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    std::mt19937 rng(0x7ace);
+    std::vector<riscv_lu> trace(count);
+    for (size_t i = 0; i < count; i++)
+        trace[i] = distinct[pick(rng)];
+
+    mwg_bench_result cold = mwg_bench_run(trace, [](riscv_decode &dec, riscv_lu inst) {
+        riscv_decode_instruction<riscv_decode,riscv_profile_rv64gc>(dec, inst);
+    });
+    riscv_decode_cache cache(riscv_profile_select("rv64gc")->decode_instruction, cache_entries);
+    mwg_bench_result cached = mwg_bench_run(trace, [&](riscv_decode &dec, riscv_lu inst) {
+        cache.decode(dec, inst);
+    });
+    mwg_bench_print(words, "rv64gc", "cold", cold);
+    mwg_bench_print(words, "rv64gc", "cached", cached);
+    if (!mwg_bench_json)
+        printf("%-8s %-8s %-18s %8zu distinct %8zu entries %6.2f%% hits  %.2fx speedup\n",
+        words, "rv64gc", "cache", distinct.size(), cache.size(),
+        100.0 * cache.hits / (cache.hits + cache.misses), cold.ns_per_inst / cached.ns_per_inst);
+    if (cold.checksum != cached.checksum) {
+        fprintf(stderr, "%s: cached decode disagrees with riscv_decode_instruction\n", words);
+        return false;
+    }
+    return true;
+}
+
+//First num_distinct different words of insts that decode as legal RV64GC
+static std::vector<riscv_lu> mwg_bench_distinct_legal(const std::vector<riscv_lu> &insts, size_t num_distinct) {
+    std::vector<riscv_lu> distinct;
+    std::map<riscv_lu,bool> seen;
+    for (size_t i = 0; i < insts.size() && distinct.size() < num_distinct; i++) {
+        riscv_decode dec = riscv_decode();
+        riscv_decode_opcode<riscv_decode,riscv_profile_rv64gc>(dec, insts[i]);
+        if (dec.op != riscv_op_unknown && !seen[insts[i]]) {
+            seen[insts[i]] = true;
+            distinct.push_back(insts[i]);
+        }
+    }
+    return distinct;
+}
+
+//First count words of the stream that decode as legal RV64GC
+static std::vector<riscv_lu> mwg_bench_legal_words(std::mt19937 &rng, size_t count) {
+    std::vector<riscv_lu> insts;
+    insts.reserve(count);
+    while (insts.size() < count) {
+        riscv_lu inst = rng();
+        riscv_decode dec = riscv_decode();
+        riscv_decode_opcode<riscv_decode,riscv_profile_rv64gc>(dec, inst);
+        if (dec.op != riscv_op_unknown)
+            insts.push_back(inst);
+    }
+    return insts;
+}
+
+//Collects every instruction parcel from the executable sections of an ELF
+static std::vector<riscv_lu> mwg_bench_text_words(std::string filename) {
+    std::vector<riscv_lu> insts;
+    elf_file elf;
+    elf.load_mmap(filename);
+    for (size_t i = 0; i < elf.shdrs.size(); i++) {
+        if (!(elf.shdrs[i].sh_flags & SHF_EXECINSTR) || elf.shdrs[i].sh_type == SHT_NOBITS) continue;
+        riscv_ptr pc = (riscv_ptr)elf.sections[i].data();
+        riscv_ptr end = pc + elf.sections[i].length();
+        while (pc + 2 <= end && pc + riscv_get_instruction_length(htole16(*(uint16_t*)pc)) <= end) {
+            insts.push_back(riscv_get_instruction(pc, &pc));
+        }
+    }
+    return insts;
+}
+
+int main(int argc, const char *argv[])
+{
+    size_t count = 1 << 24;
+    std::string elf_filename;
+    size_t num_distinct = 4096;
+    size_t cache_entries = 16384;
+    size_t slow_count = 1 << 16;
+    bool help = false;
+
+    cmdline_option options[] = {
+        { "-n", "--count", cmdline_arg_type_int,
+            "Number of uniformly random words",
+            [&](std::string s) { count = strtoull(s.c_str(), nullptr, 0); return count > 0; } },
+        { "-e", "--elf", cmdline_arg_type_string,
+            "Also benchmark the .text words of this ELF",
+            [&](std::string s) { elf_filename = s; return true; } },
+        { "-d", "--distinct", cmdline_arg_type_int,
+            "Distinct words in the replayed trace",
+            [&](std::string s) { num_distinct = strtoull(s.c_str(), nullptr, 0); return num_distinct > 0; } },
+        { "-C", "--cache", cmdline_arg_type_int,
+            "Decode cache entries for the replayed trace",
+            [&](std::string s) { cache_entries = strtoull(s.c_str(), nullptr, 0); return cache_entries > 0; } },
+        { "-s", "--slow-count", cmdline_arg_type_int,
+            "Words timed through the printing stages (disasm_*, mwg_decode)",
+            [&](std::string s) { slow_count = strtoull(s.c_str(), nullptr, 0); return slow_count > 0; } },
+        { "-j", "--json", cmdline_arg_type_none,
+            "Print the results as one JSON document",
+            [&](std::string s) { return (mwg_bench_json = true); } },
+        { "-h", "--help", cmdline_arg_type_none,
+            "Show help",
+            [&](std::string s) { return (help = true); } },
+        { nullptr, nullptr, cmdline_arg_type_none, nullptr, nullptr }
+    };
+
+    auto result = cmdline_option::process_options(options, argc, argv);
+    if (!result.second || help || result.first.size() > 0) {
+        printf("Usage: %s [options]\n", argv[0]);
+        cmdline_option::print_options(options);
+        return help ? 0 : 1;
+    }
+
+    std::mt19937 rng(0x5decc);
+    std::vector<riscv_lu> random_words(count);
+    for (size_t i = 0; i < count; i++)
+        random_words[i] = rng();
+
+    bool agree = mwg_bench_check_rules();
+    agree &= mwg_bench_compare_backends<riscv_profile_rv64g>("random", "rv64g", random_words);
+    agree &= mwg_bench_compare_backends<riscv_profile_rv64gc>("random", "rv64gc", random_words);
+    agree &= mwg_bench_classify("random", random_words);
+    agree &= mwg_bench_trace("trace", mwg_bench_distinct_legal(random_words, num_distinct), count, cache_entries);
+    mwg_bench_stages("random", random_words, slow_count);
+    mwg_bench_stages("legal", mwg_bench_legal_words(rng, count), slow_count);
+
+    //This executable is a host ELF, so most of its words do not decode as RISC-V
+    agree &= mwg_bench_disasm_threads("self", access("/proc/self/exe", R_OK) == 0 ? "/proc/self/exe" : argv[0]);
+
+    if (elf_filename.size() > 0) {
+        std::vector<riscv_lu> text_words = mwg_bench_text_words(elf_filename);
+        if (text_words.size() == 0) {
+            fprintf(stderr, "%s: no executable sections\n", elf_filename.c_str());
+            return 1;
+        }
+        agree &= mwg_bench_compare_backends<riscv_profile_rv64gc>(".text", "rv64gc", text_words);
+        agree &= mwg_bench_classify(".text", text_words);
+        agree &= mwg_bench_disasm_threads(".text", elf_filename.c_str());
+        agree &= mwg_bench_trace(".trace", mwg_bench_distinct_legal(text_words, num_distinct), count, cache_entries);
+        mwg_bench_stages(".text", text_words, slow_count);
+    }
+
+    if (mwg_bench_json)
+        mwg_bench_print_json(count, agree);
+
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_census.h"
+#include "mwg_work_steal.h"
+#include "mwg_decode.h"
+
+#include <cstring>
+#include <string>
+#include <stdint.h>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-decode-table.h"
+#include "riscv-profile.h"
+
+#define MWG_CENSUS_NUM_OPS (riscv_op_c_sdsp + 1)
+#define MWG_CENSUS_NUM_CODECS (riscv_codec_uj + 1)
+
+mwg_census_decode_fn mwg_census_isa_decoder(const char *isa) {
+    const riscv_profile_decoder *decoder = riscv_profile_select(isa);
+    return decoder ? decoder->decode_ops : nullptr;
+}
+
+//Per-thread scratch and histograms, merged once the sweep is done
+struct mwg_census_worker {
+    std::vector<uint32_t> words;
+    std::vector<uint16_t> ops;
+    std::vector<uint64_t> op_count;
+};
+
+int mwg_census_run(const mwg_census_config &config, mwg_census_result *result) {
+    if (!config.decode || (config.fixed_value & ~config.fixed_mask)) {
+        fprintf(stderr, "error census: missing decoder or fixed value outside fixed mask\n");
+        return 1;
+    }
+
+    unsigned free_bits = 32 - __builtin_popcount(config.fixed_mask);
+    unsigned block_bits = std::min<unsigned>(free_bits, MWG_CENSUS_BLOCK_BITS);
+    uint64_t block_size = uint64_t(1) << block_bits;
+    uint64_t num_blocks = uint64_t(1) << (free_bits - block_bits);
+    uint32_t free_mask = ~config.fixed_mask;
+
+    unsigned num_threads = mwg_work_steal_threads(config.num_threads);
+    std::vector<mwg_census_worker> workers(num_threads);
+    for (auto &worker : workers) {
+        worker.words.resize(block_size);
+        worker.ops.resize(block_size);
+        worker.op_count.assign(MWG_CENSUS_NUM_OPS, 0);
+    }
+
+    mwg_work_steal_for(num_blocks, num_threads, [&](unsigned t, uint64_t block) {
+        mwg_census_worker &worker = workers[t];
+
+        //Scatter the rank of the first word into the free bits, then step with a carry through the fixed bits
+        uint64_t rank = block << block_bits;
+        uint32_t word = config.fixed_value;
+        for (uint32_t m = free_mask; m != 0 && rank != 0; m &= m - 1, rank >>= 1) {
+            if (rank & 1)
+                word |= m & -m;
+        }
+        for (uint64_t i = 0; i < block_size; i++) {
+            worker.words[i] = word;
+            word = (((word | config.fixed_mask) + 1) & free_mask) | config.fixed_value;
+        }
+
+        config.decode(worker.words.data(), block_size, worker.ops.data());
+        for (uint64_t i = 0; i < block_size; i++)
+            worker.op_count[worker.ops[i]]++;
+        if (config.block_fn)
+            config.block_fn(block, worker.words.data(), worker.ops.data(), block_size);
+    });
+
+    result->num_words = num_blocks * block_size;
+    result->op_count.assign(MWG_CENSUS_NUM_OPS, 0);
+    result->codec_count.assign(MWG_CENSUS_NUM_CODECS, 0);
+    for (auto &worker : workers) {
+        for (size_t op = 0; op < MWG_CENSUS_NUM_OPS; op++)
+            result->op_count[op] += worker.op_count[op];
+    }
+    for (size_t op = 0; op < MWG_CENSUS_NUM_OPS; op++)
+        result->codec_count[riscv_instruction_codec[op]] += result->op_count[op];
+    result->num_legal = result->num_words - result->op_count[riscv_op_unknown];
+    return 0;
+}
+
+void mwg_census_print(const mwg_census_result &result, FILE *out) {
+    fprintf(out, "words %llu legal %llu\n",
+        (unsigned long long)result.num_words, (unsigned long long)result.num_legal);
+    for (size_t op = 0; op < result.op_count.size(); op++) {
+        if (result.op_count[op])
+            fprintf(out, "op %-16s %12llu\n", riscv_instruction_name[op], (unsigned long long)result.op_count[op]);
+    }
+    for (size_t codec = 0; codec < result.codec_count.size(); codec++) {
+        if (result.codec_count[codec])
+            fprintf(out, "codec %-13s %12llu\n", mwg_codec_name(codec), (unsigned long long)result.codec_count[codec]);
+    }
+}
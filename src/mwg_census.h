@@ -0,0 +1,56 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_census_h
+#define mwg_census_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <functional>
+
+#define MWG_CENSUS_BLOCK_BITS 16
+
+/* Decodes count words into riscv_op ids for one ISA subset */
+typedef void (*mwg_census_decode_fn)(const uint32_t *words, size_t count, uint16_t *ops);
+
+/*
+ * Called once per block with the words of that block and their op ids.
+ * Blocks are numbered in word order within the subspace and are handed out
+ * from several threads at once, in no particular order.
+ */
+typedef std::function<void(uint64_t block, const uint32_t *words, const uint16_t *ops, size_t count)> mwg_census_block_fn;
+
+/*
+ * Sweep description. Only words with (word & fixed_mask) == fixed_value are
+ * visited, so a zero mask walks the whole 2^32 space. Blocks hold 2^16
+ * consecutive words of the subspace (fewer if it is smaller than that).
+ */
+struct mwg_census_config {
+    uint32_t fixed_mask;
+    uint32_t fixed_value;
+    unsigned num_threads;           //0 = one per core
+    mwg_census_decode_fn decode;
+    mwg_census_block_fn block_fn;   //optional
+};
+
+struct mwg_census_result {
+    uint64_t num_words;
+    uint64_t num_legal;
+    std::vector<uint64_t> op_count;      //indexed by riscv_op
+    std::vector<uint64_t> codec_count;   //indexed by riscv_codec
+};
+
+/* Returns the pre-instantiated decoder of an ISA profile such as "rv64g" or "rv32imac", or nullptr */
+mwg_census_decode_fn mwg_census_isa_decoder(const char *isa);
+
+/* Runs the sweep. Returns 0 on success. */
+int mwg_census_run(const mwg_census_config &config, mwg_census_result *result);
+
+/* Prints the nonzero op and codec counts */
+void mwg_census_print(const mwg_census_result &result, FILE *out);
+
+#endif
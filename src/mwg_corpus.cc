@@ -0,0 +1,451 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_corpus.h"
+#include "mwg_work_steal.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <functional>
+#include <algorithm>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-elf.h"
+#include "riscv-elf-file.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-decode-table.h"
+#include "riscv-profile.h"
+
+static const char mwg_corpus_magic[8] = { 'M', 'W', 'G', 'C', 'O', 'R', 'P', '\0' };
+#define MWG_CORPUS_VERSION 1
+
+unsigned mwg_corpus_imm_bucket(int64_t imm) {
+    if (imm == 0)
+        return 64;
+    uint64_t mag = imm < 0 ? -uint64_t(imm) : uint64_t(imm);
+    unsigned bits = 64 - __builtin_clzll(mag);
+    return imm < 0 ? 64 - bits : 64 + bits;
+}
+
+void mwg_corpus_hist_init(mwg_corpus_hist *hist) {
+    hist->num_insts = 0;
+    hist->op_count.assign(riscv_op_c_sdsp + 1, 0);
+    hist->reg_count.assign(MWG_CORPUS_REG_SLOTS * 32, 0);
+    hist->imm_count.assign(MWG_CORPUS_IMM_BUCKETS, 0);
+}
+
+static void mwg_corpus_hist_add(mwg_corpus_hist *into, const mwg_corpus_hist &from) {
+    into->num_insts += from.num_insts;
+    for (size_t i = 0; i < into->op_count.size(); i++)
+        into->op_count[i] += from.op_count[i];
+    for (size_t i = 0; i < into->reg_count.size(); i++)
+        into->reg_count[i] += from.reg_count[i];
+    for (size_t i = 0; i < into->imm_count.size(); i++)
+        into->imm_count[i] += from.imm_count[i];
+}
+
+static void mwg_corpus_total(mwg_corpus_index *index) {
+    mwg_corpus_hist_init(&index->total);
+    for (auto &entry : index->entries)
+        mwg_corpus_hist_add(&index->total, entry.hist);
+}
+
+//Hash of the file contents, eight bytes at a time
+static uint64_t mwg_corpus_hash(const uint8_t *data, size_t size) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    uint64_t w = 0;
+    memcpy(&w, data + i, size - i);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 29);
+}
+
+/*
+ * Binary file format
+ */
+
+static void mwg_corpus_put(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out += char(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+static bool mwg_corpus_get(const uint8_t *&p, const uint8_t *end, uint64_t *v) {
+    *v = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        *v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void mwg_corpus_put_hist(std::string &out, const mwg_corpus_hist &hist) {
+    mwg_corpus_put(out, hist.num_insts);
+    for (auto n : hist.op_count)
+        mwg_corpus_put(out, n);
+    for (auto n : hist.reg_count)
+        mwg_corpus_put(out, n);
+    for (auto n : hist.imm_count)
+        mwg_corpus_put(out, n);
+}
+
+static bool mwg_corpus_get_hist(const uint8_t *&p, const uint8_t *end, mwg_corpus_hist *hist) {
+    mwg_corpus_hist_init(hist);
+    bool ok = mwg_corpus_get(p, end, &hist->num_insts);
+    for (auto &n : hist->op_count)
+        ok = ok && mwg_corpus_get(p, end, &n);
+    for (auto &n : hist->reg_count)
+        ok = ok && mwg_corpus_get(p, end, &n);
+    for (auto &n : hist->imm_count)
+        ok = ok && mwg_corpus_get(p, end, &n);
+    return ok;
+}
+
+int mwg_corpus_load(const char *filename, mwg_corpus_index *index) {
+    index->entries.clear();
+    mwg_corpus_hist_init(&index->total);
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        if (errno == ENOENT)
+            return 0;
+        perror(filename);
+        return 1;
+    }
+    std::vector<uint8_t> buf;
+    uint8_t chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        buf.insert(buf.end(), chunk, chunk + n);
+    bool read_error = ferror(file);
+    fclose(file);
+    if (read_error) {
+        perror(filename);
+        return 1;
+    }
+
+    const uint8_t *p = buf.data(), *end = buf.data() + buf.size();
+    uint64_t version, num_ops, num_regs, num_imms, num_entries;
+    bool ok = buf.size() >= sizeof(mwg_corpus_magic) && memcmp(p, mwg_corpus_magic, sizeof(mwg_corpus_magic)) == 0;
+    if (ok)
+        p += sizeof(mwg_corpus_magic);
+    ok = ok && mwg_corpus_get(p, end, &version) && mwg_corpus_get(p, end, &num_ops)
+        && mwg_corpus_get(p, end, &num_regs) && mwg_corpus_get(p, end, &num_imms)
+        && mwg_corpus_get(p, end, &num_entries);
+    if (ok && (version != MWG_CORPUS_VERSION || num_ops != riscv_op_c_sdsp + 1
+            || num_regs != MWG_CORPUS_REG_SLOTS * 32 || num_imms != MWG_CORPUS_IMM_BUCKETS)) {
+        fprintf(stderr, "error incompatible corpus index: %s\n", filename);
+        return 1;
+    }
+    for (uint64_t i = 0; ok && i < num_entries; i++) {
+        mwg_corpus_entry entry;
+        uint64_t len;
+        ok = mwg_corpus_get(p, end, &len) && len <= uint64_t(end - p);
+        if (!ok)
+            break;
+        entry.path.assign((const char*)p, len);
+        p += len;
+        ok = mwg_corpus_get(p, end, &entry.size) && mwg_corpus_get(p, end, &entry.mtime_ns)
+            && mwg_corpus_get(p, end, &entry.hash) && mwg_corpus_get_hist(p, end, &entry.hist);
+        if (ok)
+            index->entries.push_back(std::move(entry));
+    }
+    ok = ok && mwg_corpus_get_hist(p, end, &index->total) && p == end;
+    if (!ok) {
+        fprintf(stderr, "error malformed corpus index: %s\n", filename);
+        return 1;
+    }
+    std::sort(index->entries.begin(), index->entries.end(), [](const mwg_corpus_entry &a, const mwg_corpus_entry &b) {
+        return a.path < b.path;
+    });
+    return 0;
+}
+
+int mwg_corpus_save(const char *filename, const mwg_corpus_index &index) {
+    std::string out(mwg_corpus_magic, sizeof(mwg_corpus_magic));
+    mwg_corpus_put(out, MWG_CORPUS_VERSION);
+    mwg_corpus_put(out, riscv_op_c_sdsp + 1);
+    mwg_corpus_put(out, MWG_CORPUS_REG_SLOTS * 32);
+    mwg_corpus_put(out, MWG_CORPUS_IMM_BUCKETS);
+    mwg_corpus_put(out, index.entries.size());
+    for (auto &entry : index.entries) {
+        mwg_corpus_put(out, entry.path.size());
+        out += entry.path;
+        mwg_corpus_put(out, entry.size);
+        mwg_corpus_put(out, entry.mtime_ns);
+        mwg_corpus_put(out, entry.hash);
+        mwg_corpus_put_hist(out, entry.hist);
+    }
+    mwg_corpus_put_hist(out, index.total);
+
+    std::string tmp = std::string(filename) + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file) {
+        perror(tmp.c_str());
+        return 1;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), filename) != 0) {
+        perror(filename);
+        unlink(tmp.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+//Adds the entries of from to into; a path in both keeps the entry from from, or the newer one if newer_only
+static void mwg_corpus_combine(mwg_corpus_index *into, const mwg_corpus_index &from, bool newer_only) {
+    std::map<std::string, const mwg_corpus_entry*> chosen;
+    for (auto &entry : into->entries)
+        chosen[entry.path] = &entry;
+    for (auto &entry : from.entries) {
+        auto it = chosen.find(entry.path);
+        if (it == chosen.end() || !newer_only || it->second->mtime_ns < entry.mtime_ns)
+            chosen[entry.path] = &entry;
+    }
+    std::vector<mwg_corpus_entry> entries;
+    entries.reserve(chosen.size());
+    for (auto &it : chosen)
+        entries.push_back(*it.second);
+    into->entries.swap(entries);
+    mwg_corpus_total(into);
+}
+
+void mwg_corpus_merge(mwg_corpus_index *into, const mwg_corpus_index &from) {
+    mwg_corpus_combine(into, from, true);
+}
+
+/*
+ * Scanning
+ */
+
+struct mwg_corpus_file {
+    std::string path;
+    uint64_t size;
+    uint64_t mtime_ns;
+};
+
+static uint64_t mwg_corpus_mtime_ns(const struct stat &stat_buf) {
+#if defined(__APPLE__)
+    return uint64_t(stat_buf.st_mtimespec.tv_sec) * 1000000000 + stat_buf.st_mtimespec.tv_nsec;
+#else
+    return uint64_t(stat_buf.st_mtim.tv_sec) * 1000000000 + stat_buf.st_mtim.tv_nsec;
+#endif
+}
+
+//Collects the regular files under path; symbolic links are not followed
+static void mwg_corpus_walk(const std::string &path, std::vector<mwg_corpus_file> &files) {
+    struct stat stat_buf;
+    if (lstat(path.c_str(), &stat_buf) < 0) {
+        perror(path.c_str());
+        return;
+    }
+    if (S_ISREG(stat_buf.st_mode)) {
+        files.push_back(mwg_corpus_file{ path, uint64_t(stat_buf.st_size), mwg_corpus_mtime_ns(stat_buf) });
+        return;
+    }
+    if (!S_ISDIR(stat_buf.st_mode))
+        return;
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        perror(path.c_str());
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent *ent = readdir(dir)) {
+        if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0)
+            names.push_back(ent->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (auto &name : names)
+        mwg_corpus_walk(path.back() == '/' ? path + name : path + "/" + name, files);
+}
+
+//True if the file starts with the header of a RISC-V ELF, which elf_file can load without failing on the magic
+static bool mwg_corpus_is_riscv_elf(const char *path) {
+    uint8_t ident[20];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ok = read(fd, ident, sizeof(ident)) == ssize_t(sizeof(ident)) && elf_check_magic(ident)
+        && (ident[EI_CLASS] == ELFCLASS32 || ident[EI_CLASS] == ELFCLASS64);
+    close(fd);
+    if (!ok)
+        return false;
+    uint16_t e_machine;
+    memcpy(&e_machine, ident + 18, sizeof(e_machine));
+    e_machine = ident[EI_DATA] == ELFDATA2MSB ? be16toh(e_machine) : le16toh(e_machine);
+    return e_machine == EM_RISCV;
+}
+
+static void mwg_corpus_count(const riscv_profile_decoder *decoder, riscv_lu inst, size_t length, mwg_corpus_hist *hist) {
+    hist->num_insts++;
+    if (length > 4) {
+        hist->op_count[riscv_op_unknown]++;
+        return;
+    }
+    riscv_decode dec = riscv_decode();
+    decoder->decode_opcode(dec, inst);
+    hist->op_count[dec.op]++;
+    if (dec.op == riscv_op_unknown)
+        return;
+    riscv_decode_type(dec, inst);
+    riscv_decode_decompress(dec);
+
+    //Which operands exist follows the codec of the expanded instruction
+    riscv_codec codec = riscv_instruction_codec[dec.op];
+    if (codec < riscv_codec_i)
+        return;
+    bool has_rd = codec != riscv_codec_sb && codec != riscv_codec_s;
+    bool has_rs1 = codec != riscv_codec_u && codec != riscv_codec_uj;
+    bool has_rs2 = has_rs1 && codec != riscv_codec_i && codec != riscv_codec_i_sh5 && codec != riscv_codec_i_sh6;
+    bool has_rs3 = codec == riscv_codec_r_4;
+    bool has_imm = codec == riscv_codec_i || codec == riscv_codec_i_sh5 || codec == riscv_codec_i_sh6
+        || codec == riscv_codec_s || codec == riscv_codec_sb || codec == riscv_codec_u || codec == riscv_codec_uj;
+    if (has_rd)
+        hist->reg_count[0 * 32 + (dec.rd & 31)]++;
+    if (has_rs1)
+        hist->reg_count[1 * 32 + (dec.rs1 & 31)]++;
+    if (has_rs2)
+        hist->reg_count[2 * 32 + (dec.rs2 & 31)]++;
+    if (has_rs3)
+        hist->reg_count[3 * 32 + (dec.rs3 & 31)]++;
+    if (has_imm)
+        hist->imm_count[mwg_corpus_imm_bucket(dec.imm)]++;
+}
+
+enum mwg_corpus_outcome {
+    mwg_corpus_not_riscv,
+    mwg_corpus_skipped,
+    mwg_corpus_cached,
+    mwg_corpus_indexed
+};
+
+//Sets error and returns mwg_corpus_skipped for a binary that elf_file cannot load
+static mwg_corpus_outcome mwg_corpus_index_file(const mwg_corpus_file &file, const mwg_corpus_entry *old, mwg_corpus_entry *entry, std::string *error) {
+    if (old && old->size == file.size && old->mtime_ns == file.mtime_ns)
+        return mwg_corpus_cached;
+    if (!mwg_corpus_is_riscv_elf(file.path.c_str()))
+        return mwg_corpus_not_riscv;
+
+    elf_file elf;
+    if (!elf.load_mmap(file.path, *error))
+        return mwg_corpus_skipped;
+    entry->path = file.path;
+    entry->size = elf.map_size;
+    entry->mtime_ns = file.mtime_ns;
+    entry->hash = mwg_corpus_hash(elf.map, elf.map_size);
+    if (old && old->size == entry->size && old->hash == entry->hash) {
+        entry->hist = old->hist;
+        return mwg_corpus_cached;
+    }
+
+    mwg_corpus_hist_init(&entry->hist);
+    const riscv_profile_decoder *decoder = riscv_profile_select(elf.ei_class == ELFCLASS32 ? "rv32gc" : "rv64gc");
+    for (size_t i = 0; i < elf.shdrs.size(); i++) {
+        if (!(elf.shdrs[i].sh_flags & SHF_EXECINSTR) || elf.shdrs[i].sh_type == SHT_NOBITS) continue;
+        riscv_ptr pc = (riscv_ptr)elf.sections[i].data();
+        riscv_ptr end = pc + elf.sections[i].length();
+        while (pc + 2 <= end && pc + riscv_get_instruction_length(htole16(*(uint16_t*)pc)) <= end) {
+            size_t length = riscv_get_instruction_length(htole16(*(uint16_t*)pc));
+            mwg_corpus_count(decoder, riscv_get_instruction(pc, &pc), length, &entry->hist);
+        }
+    }
+    return mwg_corpus_indexed;
+}
+
+int mwg_corpus_scan(const char *const *dirs, size_t count, unsigned num_threads, mwg_corpus_index *index, mwg_corpus_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    std::vector<mwg_corpus_file> files;
+    for (size_t i = 0; i < count; i++)
+        mwg_corpus_walk(dirs[i], files);
+
+    //Entries are sorted by path, so workers look up their old entry without locking
+    auto find_old = [&](const std::string &path) -> const mwg_corpus_entry* {
+        auto it = std::lower_bound(index->entries.begin(), index->entries.end(), path,
+            [](const mwg_corpus_entry &entry, const std::string &p) { return entry.path < p; });
+        return it != index->entries.end() && it->path == path ? &*it : nullptr;
+    };
+
+    std::vector<mwg_corpus_outcome> outcomes(files.size());
+    std::vector<mwg_corpus_entry> entries(files.size());
+    std::vector<std::string> errors(files.size());
+    mwg_work_steal_for(files.size(), num_threads, [&](unsigned t, uint64_t i) {
+        outcomes[i] = mwg_corpus_index_file(files[i], find_old(files[i].path), &entries[i], &errors[i]);
+    });
+
+    mwg_corpus_index scanned;
+    std::set<std::string> found;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (outcomes[i] == mwg_corpus_not_riscv)
+            continue;
+        if (outcomes[i] == mwg_corpus_skipped) {
+            fprintf(stderr, "%s\n", errors[i].c_str());
+            stats->num_skipped++;
+            continue;
+        }
+        found.insert(files[i].path);
+        stats->num_binaries++;
+        if (outcomes[i] == mwg_corpus_indexed) {
+            stats->num_indexed++;
+            stats->num_insts += entries[i].hist.num_insts;
+            scanned.entries.push_back(std::move(entries[i]));
+            continue;
+        }
+        stats->num_cached++;
+        if (entries[i].path.size() > 0)
+            scanned.entries.push_back(std::move(entries[i])); //same contents, new mtime
+    }
+
+    //Entries under a scanned directory that the walk did not find as a RISC-V binary are gone
+    std::vector<std::string> roots;
+    for (size_t i = 0; i < count; i++) {
+        std::string root = dirs[i];
+        roots.push_back(root.size() > 0 && root.back() == '/' ? root : root + "/");
+    }
+    auto under_root = [&](const std::string &path) {
+        for (auto &root : roots) {
+            if (path.compare(0, root.size(), root) == 0 || path + "/" == root)
+                return true;
+        }
+        return false;
+    };
+    size_t num_entries = index->entries.size();
+    index->entries.erase(std::remove_if(index->entries.begin(), index->entries.end(), [&](const mwg_corpus_entry &entry) {
+        return under_root(entry.path) && found.count(entry.path) == 0;
+    }), index->entries.end());
+    stats->num_removed = num_entries - index->entries.size();
+
+    mwg_corpus_combine(index, scanned, false);
+    return 0;
+}
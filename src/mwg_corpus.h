@@ -0,0 +1,93 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_corpus_h
+#define mwg_corpus_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define MWG_CORPUS_REG_SLOTS 4      //rd, rs1, rs2, rs3
+#define MWG_CORPUS_IMM_BUCKETS 128  //see mwg_corpus_imm_bucket()
+
+/*
+ * Instruction histograms of one binary or a whole corpus. op_count is
+ * indexed by riscv_op as decoded, before compressed instructions are
+ * expanded. reg_count and imm_count follow the operands of the expanded
+ * instruction: reg_count[slot * 32 + reg] for the operand slots its codec
+ * has, and imm_count for codecs with an immediate. Parcels longer than 32
+ * bits count as riscv_op_unknown.
+ */
+struct mwg_corpus_hist {
+    uint64_t num_insts;
+    std::vector<uint64_t> op_count;
+    std::vector<uint64_t> reg_count;
+    std::vector<uint64_t> imm_count;
+};
+
+/* One indexed binary; size, mtime and hash decide whether it must be indexed again */
+struct mwg_corpus_entry {
+    std::string path;
+    uint64_t size;
+    uint64_t mtime_ns;
+    uint64_t hash;
+    mwg_corpus_hist hist;
+};
+
+/* Entries sorted by path, and their sum */
+struct mwg_corpus_index {
+    std::vector<mwg_corpus_entry> entries;
+    mwg_corpus_hist total;
+};
+
+struct mwg_corpus_stats {
+    uint64_t num_binaries;      //RISC-V ELFs found by the scan
+    uint64_t num_indexed;       //decoded this run
+    uint64_t num_cached;        //unchanged since the index was written
+    uint64_t num_insts;         //decoded this run
+    uint64_t num_skipped;       //RISC-V ELFs that are unreadable or malformed
+    uint64_t num_removed;       //entries under a scanned directory that the scan no longer found
+};
+
+/*
+ * Immediate bucket: 64 for zero, 64 + n for a positive immediate of n
+ * significant bits, 64 - n for a negative one whose magnitude has n bits
+ * (so INT64_MIN lands in bucket 0).
+ */
+unsigned mwg_corpus_imm_bucket(int64_t imm);
+
+/* Empty histograms sized for the riscv_op table of this build */
+void mwg_corpus_hist_init(mwg_corpus_hist *hist);
+
+/*
+ * Reads an index written by mwg_corpus_save(). A missing file is an empty
+ * index. Returns 0 on success, 1 if the file is unreadable, malformed, or
+ * from a build with a different riscv_op table.
+ */
+int mwg_corpus_load(const char *filename, mwg_corpus_index *index);
+
+/*
+ * Writes the index as varint-coded counts, through a temporary file that is
+ * renamed over filename. Returns 0 on success.
+ */
+int mwg_corpus_save(const char *filename, const mwg_corpus_index &index);
+
+/* Adds the entries of from to into, keeping the newer entry of a path in both, and recomputes the total */
+void mwg_corpus_merge(mwg_corpus_index *into, const mwg_corpus_index &from);
+
+/*
+ * Walks the given directories for RISC-V ELF files, without following
+ * symbolic links, and indexes them into index on num_threads workers (0 =
+ * one per core), one elf_file per binary. A binary whose path, size and
+ * mtime match an entry is skipped; one whose mtime changed is hashed and
+ * skipped if size and hash still match. Executable sections are decoded as
+ * rv32gc or rv64gc by ELF class. A binary that elf_file::load_mmap()
+ * reports as unreadable or malformed is reported on stderr and skipped. Entries under one of the directories that the walk
+ * did not find as a RISC-V binary are removed. Returns 0 on success.
+ */
+int mwg_corpus_scan(const char *const *dirs, size_t count, unsigned num_threads, mwg_corpus_index *index, mwg_corpus_stats *stats);
+
+#endif
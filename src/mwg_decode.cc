@@ -18,6 +18,7 @@
 #include <iostream>
 #include <iomanip>
 #include <chrono>
+#include <memory>
 #include <stdint.h>
 //#include <deque>
 
@@ -30,11 +31,146 @@
 #include "riscv-elf-format.h"
 #include "riscv-imm.h"
 #include "riscv-decode.h"
+#include "riscv-decode-table.h"
+#include "riscv-profile.h"
+#include "riscv-decode-cache.h"
 //#include "riscv-disasm.h"
 
-int mwg_decode(std::string instString) {
-    int retval = 1;
+static const char *mwg_codec_names[] = {
+    "unknown", "none",
+    "cb", "cb_sh5", "ci", "ci_sh5", "ci_16sp", "ci_lwsp", "ci_ldsp", "ci_li", "ci_lui", "ci_nop",
+    "ciw_4spn", "cj", "cl_lw", "cl_ld", "cr", "cr_mv", "cr_jalr", "cr_jr",
+    "cs", "cs_sw", "cs_sd", "css_swsp", "css_sdsp",
+    "i", "i_sh5", "i_sh6", "r", "r_m", "r_4", "r_a", "r_l", "s", "sb", "u", "uj"
+};
+
+const char *mwg_codec_name(uint16_t codec) {
+    if (codec > riscv_codec_uj)
+        return "FAILURE";
+    return mwg_codec_names[codec];
+}
+
+//nullptr until mwg_decode_select_isa() picks a profile, which means RV64G
+static const riscv_profile_decoder *mwg_decoder = nullptr;
+
+//Bumped by every profile switch so per-thread caches drop decodes of the old profile
+static uint64_t mwg_decoder_generation = 0;
+
+int mwg_decode_select_isa(const char *isa) {
+    const riscv_profile_decoder *decoder = riscv_profile_select(isa);
+    if (!decoder)
+        return 1;
+    mwg_decoder = decoder;
+    mwg_decoder_generation++;
+    return 0;
+}
+
+std::string mwg_decode_isa_names() {
+    return riscv_profile_names();
+}
+
+static inline void mwg_decode_opcode(riscv_decode &dec, uint32_t raw) {
+    if (mwg_decoder)
+        mwg_decoder->decode_opcode(dec, raw);
+    else
+        riscv_decode_opcode<riscv_decode,riscv_profile_rv64g>(dec, raw); //RV64G without compressed inst
+}
+
+//Opcode and operands, without decompression so compressed words keep their own mnemonic
+static void mwg_decode_fields(riscv_decode &dec, riscv_lu raw) {
+    mwg_decode_opcode(dec, uint32_t(raw));
+    riscv_decode_type(dec, raw);
+}
+
+//0 disables the cache; each thread builds its own on first use
+static size_t mwg_cache_entries = 0;
+static thread_local std::unique_ptr<riscv_decode_cache> mwg_cache;
+static thread_local uint64_t mwg_cache_generation = 0;
+
+void mwg_decode_set_cache(size_t num_entries) {
+    mwg_cache_entries = num_entries;
+}
+
+void mwg_decode_cache_stats(uint64_t *hits, uint64_t *misses) {
+    *hits = mwg_cache ? mwg_cache->hits : 0;
+    *misses = mwg_cache ? mwg_cache->misses : 0;
+}
+
+static inline void mwg_decode_cached(riscv_decode &dec, uint32_t raw) {
+    if (mwg_cache_entries == 0) {
+        mwg_decode_fields(dec, raw);
+        return;
+    }
+    if (!mwg_cache || mwg_cache->size() < mwg_cache_entries)
+        mwg_cache.reset(new riscv_decode_cache(mwg_decode_fields, mwg_cache_entries));
+    else if (mwg_cache_generation != mwg_decoder_generation)
+        mwg_cache->clear();
+    mwg_cache_generation = mwg_decoder_generation;
+    mwg_cache->decode(dec, raw);
+}
+
+const char *mwg_op_name(uint16_t op) {
+    if (op > riscv_op_c_sdsp)
+        return "unknown";
+    return riscv_instruction_name[op];
+}
+
+int mwg_decode_word(uint32_t raw, mwg_result *result) {
+    struct riscv_decode dec = riscv_decode();
+    mwg_decode_cached(dec, raw);
+
+    enum riscv_codec codec = riscv_instruction_codec[dec.op];
+    bool legal = (dec.op != riscv_op_unknown);
+    bool legal_codec = (codec >= riscv_codec_i && codec <= riscv_codec_uj); //the printer has no operand layout for compressed codecs
+    bool float_op = (riscv_instruction_name[dec.op][0] == 'f');
+    const char **registers = float_op ? riscv_f_registers : riscv_i_registers;
+
+    result->raw = raw;
+    result->legal = legal;
+    result->legal_codec = legal_codec;
+    result->float_op = float_op;
+    result->op = dec.op;
+    result->codec = codec;
+    result->mnemonic = legal ? riscv_instruction_name[dec.op] : nullptr;
+    result->codec_name = mwg_codec_name(codec);
+    result->rd = dec.rd;
+    result->rs1 = dec.rs1;
+    result->rs2 = dec.rs2;
+    result->rs3 = dec.rs3;
+
+    //Which operands exist follows the codec
+    bool has_rd = legal_codec && codec != riscv_codec_sb && codec != riscv_codec_s;
+    bool has_rs1 = legal_codec && codec != riscv_codec_u && codec != riscv_codec_uj;
+    bool has_rs2 = legal_codec && codec != riscv_codec_u && codec != riscv_codec_uj && codec != riscv_codec_i;
+    bool has_rs3 = codec == riscv_codec_r_4 && float_op;
+    result->rd_name = has_rd ? registers[dec.rd] : nullptr;
+    result->rs1_name = has_rs1 ? registers[dec.rs1] : nullptr;
+    result->rs2_name = has_rs2 ? registers[dec.rs2] : nullptr;
+    result->rs3_name = has_rs3 ? riscv_f_registers[dec.rs3] : nullptr;
+
+    result->has_imm = legal_codec && codec != riscv_codec_r;
+    result->has_arg = (codec == riscv_codec_r_m || codec == riscv_codec_r_l || codec == riscv_codec_r_a) && float_op;
+    result->imm = dec.imm;
+    result->arg = dec.arg;
+
+    return legal ? 0 : 1;
+}
+
+static void mwg_print_name(const char *label, const char *name) {
+    std::cout << label << (name ? name : "NA") << std::endl;
+}
+
+static void mwg_print_hex(const char *label, bool present, int64_t value) {
+    std::cout << label;
+    if (present) {
+        std::cout.fill('0');
+        std::cout << " 0x" << std::hex << std::setw(16) << value << std::endl;
+    } else {
+        std::cout << "NA" << std::endl;
+    }
+}
 
+int mwg_decode(std::string instString) {
     std::cout << "Raw input: " << instString << std::endl;
     
     std::stringstream ss;
@@ -46,150 +182,42 @@ int mwg_decode(std::string instString) {
     std::cout << "Interpreted as: 0x" << std::hex << std::setw(8) << raw << std::dec << std::endl;
     std::cout.fill(' ');
 
-    struct riscv_disasm dec;
-    memset(&dec, 0, sizeof(dec));
-    dec.inst = raw;
-    riscv_decode_opcode<riscv_disasm,false,true,true,true,true,true,true,true,false>(dec, dec.inst); //RV64G without compressed inst
-    riscv_decode_type(dec, dec.inst);
-
-    //Spit out legality first
-    bool legal_op = false;
-    std::cout << "Legality: ";
-    if (dec.op == riscv_op_unknown) {
-        std::cout << "ILLEGAL" << std::endl;
-        retval = 1;
-        legal_op = false;
-    } else {
-        std::cout << "valid" << std::endl;
-        retval = 0;
-        legal_op = true;
-    }
+    mwg_result result;
+    int retval = mwg_decode_word(raw, &result);
 
-    //Operation mneumonic
-    std::cout << "Mneumonic: ";
-    if (legal_op)
-        std::cout << riscv_instruction_name[dec.op] << std::endl;
-    else
-        std::cout << "NA" << std::endl;
+    std::cout << "Legality: " << (result.legal ? "valid" : "ILLEGAL") << std::endl;
+    mwg_print_name("Mneumonic: ", result.mnemonic);
+    std::cout << "Codec: " << result.codec_name << std::endl;
+    mwg_print_name("rd: ", result.rd_name);
+    mwg_print_name("rs1: ", result.rs1_name);
+    mwg_print_name("rs2: ", result.rs2_name);
+    mwg_print_name("rs3: ", result.rs3_name);
+    mwg_print_hex("imm: ", result.has_imm, result.imm);
+    mwg_print_hex("arg: ", result.has_arg, result.arg);
 
-    //Floating pt op?
-    bool float_op = (riscv_instruction_name[dec.op][0] == 'f');
+    return retval;
+}
 
-    //Codec
-    enum riscv_codec codec = riscv_instruction_codec[dec.op];
-    bool legal_codec = true;
-    std::cout << "Codec: ";
-    switch (codec) {
-        default:                        std::cout << "FAILURE" << std::endl;    legal_codec = false;    break; 
-        case riscv_codec_unknown:       std::cout << "unknown" << std::endl;    legal_codec = false;    break; 
-        case riscv_codec_none:          std::cout << "none" << std::endl;       legal_codec = false;    break;
-        /*case riscv_codec_cb:            std::cout << "cb" << std::endl;         break;
-        case riscv_codec_cb_sh5:        std::cout << "cb_sh5" << std::endl;     break;
-        case riscv_codec_ci:            std::cout << "ci" << std::endl;         break;
-        case riscv_codec_ci_sh5:        std::cout << "ci_sh5" << std::endl;     break;
-        case riscv_codec_ci_16sp:       std::cout << "ci_16sp" << std::endl;    break;
-        case riscv_codec_ci_lwsp:       std::cout << "ci_lwsp" << std::endl;    break;
-        case riscv_codec_ci_ldsp:       std::cout << "ci_ldsp" << std::endl;    break;
-        case riscv_codec_ci_li:         std::cout << "ci_li" << std::endl;      break;
-        case riscv_codec_ci_lui:        std::cout << "ci_lui" << std::endl;     break;
-        case riscv_codec_ci_nop:        std::cout << "ci_nop" << std::endl;     break;
-        case riscv_codec_ciw_4spn:      std::cout << "ciw_4spn" << std::endl;   break;
-        case riscv_codec_cj:            std::cout << "cj" << std::endl;         break;
-        case riscv_codec_cl_lw:         std::cout << "cl_lw" << std::endl;      break;
-        case riscv_codec_cl_ld:         std::cout << "cl_ld" << std::endl;      break;
-        case riscv_codec_cr:            std::cout << "cr" << std::endl;         break;
-        case riscv_codec_cr_mv:         std::cout << "cr_mv" << std::endl;      break;
-        case riscv_codec_cr_jalr:       std::cout << "cr_jalr" << std::endl;    break;
-        case riscv_codec_cr_jr:         std::cout << "cr_jr" << std::endl;      break;
-        case riscv_codec_cs:            std::cout << "cs" << std::endl;         break;
-        case riscv_codec_cs_sw:         std::cout << "cs_sw" << std::endl;      break;
-        case riscv_codec_cs_sd:         std::cout << "cs_sd" << std::endl;      break;
-        case riscv_codec_css_swsp:      std::cout << "css_swsp" << std::endl;   break;
-        case riscv_codec_css_sdsp:      std::cout << "css_sdsp" << std::endl;   break;*/
-        case riscv_codec_i:             std::cout << "i" << std::endl;          break;
-        case riscv_codec_i_sh5:         std::cout << "i_sh5" << std::endl;      break;
-        case riscv_codec_i_sh6:         std::cout << "i_sh6" << std::endl;      break;
-        case riscv_codec_r:             std::cout << "r" << std::endl;          break;
-        case riscv_codec_r_m:           std::cout << "r_m" << std::endl;        break;
-        case riscv_codec_r_4:           std::cout << "r_4" << std::endl;        break;
-        case riscv_codec_r_a:           std::cout << "r_a" << std::endl;        break;
-        case riscv_codec_r_l:           std::cout << "r_l" << std::endl;        break;
-        case riscv_codec_s:             std::cout << "s" << std::endl;          break;
-        case riscv_codec_sb:            std::cout << "sb" << std::endl;         break;
-        case riscv_codec_u:             std::cout << "u" << std::endl;          break;
-        case riscv_codec_uj:            std::cout << "uj" << std::endl;         break;
-    }
+size_t mwg_decode_batch(const uint32_t *insts, size_t count, const mwg_batch_fields &fields) {
+    size_t num_legal = 0;
 
-    //rd
-    std::cout << "rd: ";
-    if (!legal_codec || codec == riscv_codec_sb || codec == riscv_codec_s) {
-        std::cout << "NA" << std::endl;
-    } else {
-        if (!float_op)
-            std::cout << riscv_i_registers[dec.rd] << std::endl;
-        else
-            std::cout << riscv_f_registers[dec.rd] << std::endl;
-    }
-    
-    //rs1
-    std::cout << "rs1: ";
-    if (!legal_codec || codec == riscv_codec_u || codec == riscv_codec_uj) {
-        std::cout << "NA" << std::endl;
-    } else {
-        if (!float_op)
-            std::cout << riscv_i_registers[dec.rs1] << std::endl;
-        else
-            std::cout << riscv_f_registers[dec.rs1] << std::endl;
-    }
-    
-    //rs2
-    std::cout << "rs2: ";
-    if (!legal_codec || codec == riscv_codec_u || codec == riscv_codec_uj || codec == riscv_codec_i) {
-        std::cout << "NA" << std::endl;
-    } else {
-        if (!float_op)
-            std::cout << riscv_i_registers[dec.rs2] << std::endl;
-        else
-            std::cout << riscv_f_registers[dec.rs2] << std::endl;
-    }
-    
-    //rs3
-    std::cout << "rs3: ";
-    if (codec == riscv_codec_r_4) {
-        if (!float_op)
-            std::cout << "NA" << std::endl;
-        else
-            std::cout << riscv_f_registers[dec.rs3] << std::endl;
-    } else {
-        std::cout << "NA" << std::endl;
-    }
-    
-    //imm
-    std::cout << "imm: ";
-    if (!legal_codec || codec == riscv_codec_r) {
-        std::cout << "NA" << std::endl;
-    } else {
-        std::cout.fill('0');
-        std::cout << " 0x" << std::hex << std::setw(16) << dec.imm << std::endl;
-    }
-    
-    //arg
-    std::cout << "arg: ";
-    if (codec == riscv_codec_r_m || codec == riscv_codec_r_l || codec == riscv_codec_r_a || codec == riscv_codec_r_m) {
-        if (float_op) {
-            std::cout.fill('0');
-            std::cout << " 0x" << std::hex << std::setw(16) << dec.arg << std::endl;
-        } else {
-            std::cout << "NA" << std::endl;
-        }
-    } else {
-        std::cout << "NA" << std::endl;
-    }
+    for (size_t i = 0; i < count; i++) {
+        struct riscv_decode dec = riscv_decode();
+        mwg_decode_cached(dec, insts[i]);
 
-    //Disassembly
-    //std::deque<struct riscv_disasm> dec_hist;
-    //std::cout << "disassembly: ";
-    //riscv_disasm_instruction(dec,dec_hist,0,0,0,0,0,0);
+        bool legal = (dec.op != riscv_op_unknown);
+        num_legal += legal;
 
-    return retval;
+        if (fields.legal) fields.legal[i] = legal;
+        if (fields.op)    fields.op[i] = dec.op;
+        if (fields.codec) fields.codec[i] = dec.codec;
+        if (fields.rd)    fields.rd[i] = dec.rd;
+        if (fields.rs1)   fields.rs1[i] = dec.rs1;
+        if (fields.rs2)   fields.rs2[i] = dec.rs2;
+        if (fields.rs3)   fields.rs3[i] = dec.rs3;
+        if (fields.imm)   fields.imm[i] = dec.imm;
+        if (fields.arg)   fields.arg[i] = dec.arg;
+    }
+
+    return num_legal;
 }
@@ -7,7 +7,95 @@
 #define mwg_decode_h
 
 #include <string>
+#include <cstddef>
+#include <cstdint>
 
+/*
+ * Structure-of-arrays destination for mwg_decode_batch(). Every non-null
+ * member must have room for the full batch; null members are skipped.
+ * Fields hold the raw riscv_decode values, so illegal words come back as
+ * legal = 0, op = riscv_op_unknown, codec = riscv_codec_unknown and zeros.
+ */
+struct mwg_batch_fields {
+    uint8_t *legal;
+    uint16_t *op;
+    uint16_t *codec;
+    uint8_t *rd;
+    uint8_t *rs1;
+    uint8_t *rs2;
+    uint8_t *rs3;
+    int64_t *imm;
+    uint8_t *arg;
+};
+
+/*
+ * Decoded view of one instruction word in the selected ISA profile (RV64G
+ * without compressed instructions unless mwg_decode_select_isa() was called). Plain data:
+ * the name pointers refer to the static riscv-meta tables, and operand
+ * names are nullptr where the printer would show NA. Register names are
+ * resolved as integer or float registers from the mnemonic.
+ */
+struct mwg_result {
+    uint32_t raw;
+    bool legal;                 //op != riscv_op_unknown
+    bool legal_codec;           //codec carries operands (not unknown/none)
+    bool float_op;
+    uint16_t op;                //riscv_op
+    uint16_t codec;             //riscv_codec
+    const char *mnemonic;       //nullptr when illegal
+    const char *codec_name;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t rs3;
+    const char *rd_name;
+    const char *rs1_name;
+    const char *rs2_name;
+    const char *rs3_name;
+    bool has_imm;
+    bool has_arg;
+    int64_t imm;
+    uint8_t arg;
+};
+
+/* Prints the decode of a hex instruction string to std::cout. Returns 0 if legal, 1 otherwise. */
 int mwg_decode(std::string instString);
 
+/* Fills result without allocating or touching iostreams. Returns 0 if legal, 1 otherwise. */
+int mwg_decode_word(uint32_t raw, mwg_result *result);
+
+/*
+ * Picks the ISA profile used by mwg_decode(), mwg_decode_word() and
+ * mwg_decode_batch(), e.g. "rv64gc" or "RV32IMAC". Call once at startup,
+ * before decoding from several threads. Returns 0 on success.
+ */
+int mwg_decode_select_isa(const char *isa);
+
+/*
+ * Memoizes mwg_decode_word() and mwg_decode_batch() in a per-thread cache of
+ * about num_entries words (0, the default, disables it). Call at startup,
+ * after mwg_decode_select_isa(). Pays off on traces that repeat few words.
+ * A later mwg_decode_select_isa() empties each thread's cache, and resets
+ * its hit and miss counts, the next time that thread decodes.
+ */
+void mwg_decode_set_cache(size_t num_entries);
+
+/* Hit and miss counts of the calling thread's decode cache */
+void mwg_decode_cache_stats(uint64_t *hits, uint64_t *misses);
+
+/* Comma separated names of the available ISA profiles */
+std::string mwg_decode_isa_names();
+
+/* Short name of a riscv_codec, e.g. "r_4" */
+const char *mwg_codec_name(uint16_t codec);
+
+/* Mnemonic of a riscv_op, e.g. "fmadd.d" */
+const char *mwg_op_name(uint16_t op);
+
+/*
+ * Decodes count instruction words of the selected ISA profile without touching
+ * iostreams or the heap. Returns the number of legal words.
+ */
+size_t mwg_decode_batch(const uint32_t *insts, size_t count, const mwg_batch_fields &fields);
+
 #endif
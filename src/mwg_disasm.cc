@@ -0,0 +1,169 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_disasm.h"
+#include "mwg_work_steal.h"
+#include "mwg_stream.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <stdint.h>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-elf.h"
+#include "riscv-elf-file.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-decode-table.h"
+#include "riscv-profile.h"
+#include "riscv-csr.h"
+#include "riscv-disasm.h"
+
+//Byte range [begin, end) of one section; the first part of a section carries its header line
+struct mwg_disasm_part {
+    size_t section;
+    size_t begin;
+    size_t end;
+    bool first;
+};
+
+//Length of the instruction at offset pos of sec, or 0 if it runs past the end
+static inline size_t mwg_disasm_length(elf_section &sec, size_t pos) {
+    if (pos + 2 > sec.length())
+        return 0;
+    size_t len = riscv_get_instruction_length(htole16(*(const uint16_t*)(sec.data() + pos)));
+    return pos + len <= sec.length() ? len : 0;
+}
+
+//True if the disassembler clears its history at addr
+static inline bool mwg_disasm_boundary(riscv_disasm_elf_policy &policy, Elf64_Addr addr) {
+    const char *name = policy.symbol_name(riscv_ptr(addr), false);
+    return name && strncmp(name, "LOC_", 4) != 0;
+}
+
+/*
+ * Walks instruction lengths only, cutting a section at the first symbol
+ * boundary an instruction starts on once the current part has reached
+ * MWG_DISASM_PART_SIZE bytes. Symbols inside an instruction are skipped,
+ * as the serial walk never stops there.
+ */
+static void mwg_disasm_partition(elf_file &elf, size_t section, std::vector<mwg_disasm_part> &parts) {
+    elf_section &sec = elf.sections[section];
+    Elf64_Addr base = elf.shdrs[section].sh_addr;
+    riscv_disasm_elf_policy policy(elf);
+    const std::vector<elf_symbol_range> &ranges = elf.addr_symbol_index.ranges;
+    size_t sym = elf.addr_symbol_index.lower_bound(base + 1);
+    size_t sym_end = elf.addr_symbol_index.lower_bound(base + sec.length());
+
+    size_t begin = 0, pos = 0;
+    bool first = true;
+    while (sym < sym_end) {
+        size_t target = ranges[sym].start - base;
+        if (target < begin + MWG_DISASM_PART_SIZE || !mwg_disasm_boundary(policy, ranges[sym].start)) {
+            sym++;
+            continue;
+        }
+        size_t len = 0;
+        while (pos < target && (len = mwg_disasm_length(sec, pos)) != 0)
+            pos += len;
+        if (pos < target)
+            break;
+        if (pos == target) {
+            parts.push_back(mwg_disasm_part{ section, begin, pos, first });
+            begin = pos;
+            first = false;
+        }
+        sym++;
+    }
+    parts.push_back(mwg_disasm_part{ section, begin, sec.length(), first });
+}
+
+//Disassembles one part into out
+static uint64_t mwg_disasm_run_part(elf_file &elf, const mwg_disasm_part &part, void (*decode)(riscv_decode&, riscv_lu),
+        riscv_ptr gp, riscv_disasm_elf_policy &policy, std::string &out) {
+    elf_section &sec = elf.sections[part.section];
+    riscv_ptr start = riscv_ptr(sec.data());
+    riscv_ptr pc_offset = start - elf.shdrs[part.section].sh_addr;
+    riscv_disasm_history dec_hist;
+    uint64_t num_insts = 0;
+
+    if (part.first) {
+        out += '\n';
+        out += elf.shdr_name(int(part.section));
+        out += ":\n";
+    }
+    size_t pos = part.begin, len;
+    while (pos < part.end && (len = mwg_disasm_length(sec, pos)) != 0) {
+        riscv_disasm dec = riscv_disasm();
+        riscv_ptr pc = start + pos;
+        riscv_ptr next_pc;
+        dec.pc = pc;
+        dec.inst = riscv_get_instruction(pc, &next_pc);
+        decode(dec, dec.inst);
+        riscv_disasm_instruction(out, dec, dec_hist, pc, next_pc, pc_offset, gp, policy);
+        pos += len;
+        num_insts++;
+    }
+    return num_insts;
+}
+
+int mwg_disasm_elf(const char *filename, const char *isa, int out_fd, unsigned num_threads, mwg_disasm_stats *stats) {
+    stats->num_insts = 0;
+    stats->num_parts = 0;
+
+    const char *profile = isa && isa[0] ? isa : nullptr;
+    elf_file elf;
+    std::string error;
+    if (!elf.load_mmap(filename, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (!profile)
+        profile = elf.ei_class == ELFCLASS32 ? "rv32gc" : "rv64gc";
+    const riscv_profile_decoder *decoder = riscv_profile_select(profile);
+    if (!decoder) {
+        fprintf(stderr, "error unsupported ISA profile: %s\n", profile);
+        return 1;
+    }
+
+    const Elf64_Sym *gp_sym = elf.sym_by_name("__global_pointer$");
+    riscv_ptr gp = gp_sym ? riscv_ptr(gp_sym->st_value) : 0;
+
+    std::vector<mwg_disasm_part> parts;
+    for (size_t i = 0; i < elf.shdrs.size(); i++) {
+        if ((elf.shdrs[i].sh_flags & SHF_EXECINSTR) && elf.shdrs[i].sh_type != SHT_NOBITS)
+            mwg_disasm_partition(elf, i, parts);
+    }
+    stats->num_parts = parts.size();
+
+    num_threads = mwg_work_steal_threads(num_threads);
+    uint64_t window = uint64_t(num_threads) * MWG_DISASM_WINDOW_PER_THREAD;
+    std::vector<riscv_disasm_elf_policy> policies(num_threads, riscv_disasm_elf_policy(elf));
+    std::vector<std::string> bufs(num_threads);
+    std::vector<uint64_t> num_insts(num_threads, 0);
+
+    mwg_out_buffer out(out_fd);
+    mwg_out_reorder<std::string> reorder(out, window);
+    mwg_work_ordered_for(parts.size(), num_threads, [&](unsigned t, uint64_t part) {
+        num_insts[t] += mwg_disasm_run_part(elf, parts[part], decoder->decode_instruction, gp, policies[t], bufs[t]);
+        reorder.finish(part, bufs[t]);
+    });
+    out.flush();
+
+    for (auto n : num_insts)
+        stats->num_insts += n;
+    return out.error ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_disasm_h
+#define mwg_disasm_h
+
+#include <cstdint>
+
+#define MWG_DISASM_PART_SIZE (size_t(64) << 10)
+#define MWG_DISASM_WINDOW_PER_THREAD 16
+
+struct mwg_disasm_stats {
+    uint64_t num_insts;
+    uint64_t num_parts;
+};
+
+/*
+ * Disassembles every executable section of an ELF to out_fd, one line per
+ * instruction as riscv_disasm_instruction() prints it, with symbols from
+ * the ELF and gp taken from __global_pointer$. Each section starts with a
+ * "\n<name>:\n" line and a fresh instruction history.
+ *
+ * Sections are cut into parts of at least MWG_DISASM_PART_SIZE bytes at
+ * instructions that start a (non LOC_) symbol, where the disassembler
+ * clears its history anyway, so parts are independent. num_threads workers
+ * (0 = one per core) take parts in address order from one pool and a
+ * reorder buffer writes them in that order, so the output is identical for
+ * any thread count; a worker that gets num_threads *
+ * MWG_DISASM_WINDOW_PER_THREAD parts ahead of the oldest unwritten part
+ * waits for it. isa selects the decoder profile, or nullptr/"" for
+ * rv32gc or rv64gc by ELF class. Returns 0 on success.
+ */
+int mwg_disasm_elf(const char *filename, const char *isa, int out_fd, unsigned num_threads, mwg_disasm_stats *stats);
+
+#endif
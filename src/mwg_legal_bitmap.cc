@@ -0,0 +1,167 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_legal_bitmap.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-decode-table.h"
+#include "riscv-profile.h"
+#include "riscv-classify.h"
+
+//Each work item covers 2^22 instruction words, i.e. 512 KiB of bitmap
+#define MWG_LEGAL_BITMAP_CHUNK_BITS 22
+
+static const uint32_t mwg_legal_bitmap_isa = riscv_profile_rv64g::isa;
+
+static void mwg_legal_bitmap_worker(uint64_t *bits, std::atomic<uint64_t> *next_chunk, std::atomic<uint64_t> *num_legal) {
+    const uint64_t num_chunks = uint64_t(1) << (32 - MWG_LEGAL_BITMAP_CHUNK_BITS);
+    const size_t batch = 1 << 16;
+    std::vector<riscv_wu> raw(batch);
+    std::vector<riscv_bu> legal(batch), codec(batch);
+    uint64_t count = 0;
+
+    uint64_t chunk;
+    while ((chunk = next_chunk->fetch_add(1)) < num_chunks) {
+        uint64_t first = chunk << MWG_LEGAL_BITMAP_CHUNK_BITS;
+        uint64_t last = first + (uint64_t(1) << MWG_LEGAL_BITMAP_CHUNK_BITS);
+        for (uint64_t base = first; base < last; base += batch) {
+            for (size_t i = 0; i < batch; i++)
+                raw[i] = riscv_wu(base + i);
+            riscv_classify_rv64g(raw.data(), batch, legal.data(), codec.data()); //RV64G without compressed inst
+            for (size_t i = 0; i < batch; i += 64) {
+                uint64_t word = 0;
+                for (size_t bit = 0; bit < 64; bit++)
+                    word |= uint64_t(legal[i + bit]) << bit;
+                bits[(base + i) >> 6] = word;
+                count += __builtin_popcountll(word);
+            }
+        }
+    }
+
+    num_legal->fetch_add(count);
+}
+
+int mwg_legal_bitmap_generate(const char *filename, unsigned num_threads) {
+    size_t file_size = MWG_LEGAL_BITMAP_DATA_OFFSET + MWG_LEGAL_BITMAP_DATA_SIZE;
+
+    if (num_threads == 0)
+        num_threads = std::max(1U, std::thread::hardware_concurrency());
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "error open: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    if (ftruncate(fd, file_size) < 0) {
+        fprintf(stderr, "error ftruncate: %s: %s\n", filename, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    uint8_t *map = (uint8_t*)mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "error mmap: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+
+    //Workers fill the bitmap in place
+    uint64_t *bits = (uint64_t*)(map + MWG_LEGAL_BITMAP_DATA_OFFSET);
+    std::atomic<uint64_t> next_chunk(0), num_legal(0);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < num_threads; i++)
+        workers.emplace_back(mwg_legal_bitmap_worker, bits, &next_chunk, &num_legal);
+    for (auto &worker : workers)
+        worker.join();
+
+    //Header goes last so that an interrupted run never leaves a valid-looking file
+    mwg_legal_bitmap_header header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, MWG_LEGAL_BITMAP_MAGIC, sizeof(header.magic));
+    header.version = MWG_LEGAL_BITMAP_VERSION;
+    header.isa = mwg_legal_bitmap_isa;
+    strncpy(header.isa_name, "rv64g", sizeof(header.isa_name));
+    header.num_words = uint64_t(1) << 32;
+    header.num_legal = num_legal;
+    header.data_offset = MWG_LEGAL_BITMAP_DATA_OFFSET;
+    memcpy(map, &header, sizeof(header));
+
+    int retval = 0;
+    if (msync(map, file_size, MS_SYNC) < 0) {
+        fprintf(stderr, "error msync: %s: %s\n", filename, strerror(errno));
+        retval = 1;
+    }
+    munmap(map, file_size);
+    return retval;
+}
+
+int mwg_legal_bitmap_open(const char *filename, mwg_legal_bitmap *bitmap) {
+    memset(bitmap, 0, sizeof(*bitmap));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error open: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) < 0) {
+        fprintf(stderr, "error fstat: %s: %s\n", filename, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    if (size_t(stat_buf.st_size) != MWG_LEGAL_BITMAP_DATA_OFFSET + MWG_LEGAL_BITMAP_DATA_SIZE) {
+        fprintf(stderr, "error invalid legality bitmap size: %s\n", filename);
+        close(fd);
+        return 1;
+    }
+    void *map = mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "error mmap: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+
+    mwg_legal_bitmap_header header;
+    memcpy(&header, map, sizeof(header));
+    if (memcmp(header.magic, MWG_LEGAL_BITMAP_MAGIC, sizeof(MWG_LEGAL_BITMAP_MAGIC)) != 0
+            || header.version != MWG_LEGAL_BITMAP_VERSION
+            || header.isa != mwg_legal_bitmap_isa
+            || header.data_offset != MWG_LEGAL_BITMAP_DATA_OFFSET) {
+        fprintf(stderr, "error invalid legality bitmap header: %s\n", filename);
+        munmap(map, stat_buf.st_size);
+        return 1;
+    }
+
+    bitmap->map = map;
+    bitmap->map_size = stat_buf.st_size;
+    bitmap->bits = (const uint64_t*)((const uint8_t*)map + header.data_offset);
+    bitmap->header = header;
+    return 0;
+}
+
+void mwg_legal_bitmap_close(mwg_legal_bitmap *bitmap) {
+    if (bitmap->map)
+        munmap(bitmap->map, bitmap->map_size);
+    memset(bitmap, 0, sizeof(*bitmap));
+}
@@ -0,0 +1,53 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_legal_bitmap_h
+#define mwg_legal_bitmap_h
+
+#include <cstddef>
+#include <cstdint>
+
+#define MWG_LEGAL_BITMAP_MAGIC "RVLEGAL"
+#define MWG_LEGAL_BITMAP_VERSION 1
+#define MWG_LEGAL_BITMAP_DATA_OFFSET 4096
+#define MWG_LEGAL_BITMAP_DATA_SIZE (size_t(1) << 29) //one bit per 32-bit word, 512 MiB
+
+/*
+ * On-disk header. The bitmap itself starts at data_offset, and bit (w & 63)
+ * of host-order uint64_t number (w >> 6) is set iff w is legal in the
+ * recorded ISA profile.
+ */
+struct mwg_legal_bitmap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t isa;               //riscv_isa_flags of the profile that was swept
+    char isa_name[16];
+    uint64_t num_words;
+    uint64_t num_legal;
+    uint64_t data_offset;
+};
+
+/* Read-only mapping of a bitmap file */
+struct mwg_legal_bitmap {
+    void *map;
+    size_t map_size;
+    const uint64_t *bits;
+    mwg_legal_bitmap_header header;
+
+    bool legal(uint32_t raw) const { return (bits[raw >> 6] >> (raw & 63)) & 1; }
+};
+
+/*
+ * Sweeps all 2^32 words through the RV64G legality classifier (which agrees
+ * with riscv_decode_opcode without compressed instructions) using num_threads
+ * workers (0 = one per core) and writes the bitmap file. Returns 0 on success.
+ */
+int mwg_legal_bitmap_generate(const char *filename, unsigned num_threads);
+
+/* Maps a bitmap file written by mwg_legal_bitmap_generate(). Returns 0 on success. */
+int mwg_legal_bitmap_open(const char *filename, mwg_legal_bitmap *bitmap);
+void mwg_legal_bitmap_close(mwg_legal_bitmap *bitmap);
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_sdecc.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+
+static inline void mwg_codeword_flip(mwg_codeword *c, unsigned bit) {
+    c->w[bit >> 6] ^= uint64_t(1) << (bit & 63);
+}
+
+static inline unsigned mwg_codeword_bit(const mwg_codeword &c, unsigned bit) {
+    return (c.w[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static inline unsigned mwg_secded_syndrome(const mwg_secded_code &code, const mwg_codeword &c) {
+    unsigned syndrome = 0;
+    for (unsigned r = 0; r < code.rows; r++) {
+        unsigned ones = __builtin_popcountll(code.h[r].w[0] & c.w[0]) + __builtin_popcountll(code.h[r].w[1] & c.w[1]);
+        syndrome |= (ones & 1) << r;
+    }
+    return syndrome;
+}
+
+int mwg_secded_init(mwg_secded_code *code, unsigned n, unsigned k, const mwg_codeword *h_rows) {
+    if (k == 0 || k >= n || n > MWG_SECDED_MAX_N || n - k > MWG_SECDED_MAX_ROWS || (k != 32 && k != 64)) {
+        fprintf(stderr, "error unsupported SECDED code (%u,%u)\n", n, k);
+        return 1;
+    }
+    code->n = n;
+    code->k = k;
+    code->rows = n - k;
+    memcpy(code->h, h_rows, code->rows * sizeof(mwg_codeword));
+    for (unsigned i = 0; i < (1U << MWG_SECDED_MAX_ROWS); i++)
+        code->column_index[i] = -1;
+
+    for (unsigned j = 0; j < n; j++) {
+        unsigned column = 0;
+        for (unsigned r = 0; r < code->rows; r++)
+            column |= mwg_codeword_bit(code->h[r], j) << r;
+        if (column == 0 || code->column_index[column] >= 0) {
+            fprintf(stderr, "error parity-check column %u is zero or repeated\n", j);
+            return 1;
+        }
+        code->column[j] = column;
+        code->column_index[column] = j;
+    }
+    return 0;
+}
+
+int mwg_secded_hsiao(mwg_secded_code *code, unsigned n, unsigned k) {
+    mwg_codeword h[MWG_SECDED_MAX_ROWS];
+    unsigned rows = n - k;
+    if (k >= n || rows > MWG_SECDED_MAX_ROWS) {
+        fprintf(stderr, "error unsupported SECDED code (%u,%u)\n", n, k);
+        return 1;
+    }
+    memset(h, 0, sizeof(h));
+
+    //Message columns by increasing odd weight, then numeric order
+    unsigned j = 0;
+    for (unsigned weight = 3; weight <= rows && j < k; weight += 2) {
+        for (unsigned column = 1; column < (1U << rows) && j < k; column++) {
+            if (unsigned(__builtin_popcount(column)) != weight) continue;
+            for (unsigned r = 0; r < rows; r++) {
+                if (column & (1U << r))
+                    mwg_codeword_flip(&h[r], j);
+            }
+            j++;
+        }
+    }
+    if (j < k) {
+        fprintf(stderr, "error too few parity bits for a Hsiao (%u,%u) code\n", n, k);
+        return 1;
+    }
+    for (unsigned r = 0; r < rows; r++)
+        mwg_codeword_flip(&h[r], k + r);
+
+    return mwg_secded_init(code, n, k, h);
+}
+
+int mwg_secded_load(mwg_secded_code *code, const char *filename, unsigned n, unsigned k) {
+    mwg_codeword h[MWG_SECDED_MAX_ROWS];
+    unsigned rows = n - k;
+    if (k >= n || rows > MWG_SECDED_MAX_ROWS) {
+        fprintf(stderr, "error unsupported SECDED code (%u,%u)\n", n, k);
+        return 1;
+    }
+    memset(h, 0, sizeof(h));
+
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "error fopen: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    unsigned r = 0, j = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        if (c == '0' || c == '1') {
+            if (r >= rows || j >= n) break;
+            if (c == '1')
+                mwg_codeword_flip(&h[r], j);
+            j++;
+        } else if (c == '\n' && j > 0) {
+            if (j != n) break;
+            r++;
+            j = 0;
+        }
+    }
+    fclose(file);
+    if (j == n) {
+        r++;
+        j = 0;
+    }
+    if (r != rows || j != 0) {
+        fprintf(stderr, "error parity-check matrix must be %u rows of %u bits: %s\n", rows, n, filename);
+        return 1;
+    }
+    return mwg_secded_init(code, n, k, h);
+}
+
+mwg_codeword mwg_secded_encode(const mwg_secded_code &code, uint64_t message) {
+    mwg_codeword c;
+    c.w[0] = code.k == 64 ? message : message & 0xffffffff;
+    c.w[1] = 0;
+    for (unsigned r = 0; r < code.rows; r++) {
+        if (__builtin_popcountll(code.h[r].w[0] & c.w[0]) & 1)
+            mwg_codeword_flip(&c, code.k + r);
+    }
+    return c;
+}
+
+void mwg_codeword_format(const mwg_codeword &codeword, unsigned n, char *buf) {
+    static const char digits[] = "0123456789abcdef";
+    unsigned len = (n + 3) / 4;
+    for (unsigned i = 0; i < len; i++)
+        buf[len - 1 - i] = digits[(codeword.w[i >> 4] >> ((i & 15) * 4)) & 0xf];
+    buf[len] = '\0';
+}
+
+int mwg_codeword_parse(const char *hex, mwg_codeword *codeword) {
+    codeword->w[0] = codeword->w[1] = 0;
+    if (hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X'))
+        hex += 2;
+    size_t len = strlen(hex);
+    if (len == 0 || len > 32)
+        return 1;
+    for (size_t i = 0; i < len; i++) {
+        char c = hex[len - 1 - i];
+        uint64_t digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return 1;
+        codeword->w[i >> 4] |= digit << ((i & 15) * 4);
+    }
+    return 0;
+}
+
+//Decodes the message of c and appends it to legal if every instruction in it is legal
+static void mwg_sdecc_check(const mwg_secded_code &code, const mwg_codeword &c, unsigned distance, std::vector<mwg_sdecc_candidate> *legal) {
+    mwg_sdecc_candidate candidate;
+    candidate.codeword = c;
+    candidate.message = code.k == 64 ? c.w[0] : c.w[0] & 0xffffffff;
+    candidate.distance = distance;
+    candidate.num_insts = code.k / 32;
+    for (unsigned i = 0; i < candidate.num_insts; i++) {
+        if (mwg_decode_word(uint32_t(candidate.message >> (32 * i)), &candidate.insts[i]) != 0)
+            return;
+    }
+    legal->push_back(candidate);
+}
+
+size_t mwg_sdecc_candidates(const mwg_secded_code &code, const mwg_codeword &received, std::vector<mwg_sdecc_candidate> *legal) {
+    legal->clear();
+    unsigned syndrome = mwg_secded_syndrome(code, received);
+
+    //Distance 0 and 1 have at most one candidate
+    if (syndrome == 0) {
+        mwg_sdecc_check(code, received, 0, legal);
+        return 1;
+    }
+    if (code.column_index[syndrome] >= 0) {
+        mwg_codeword c = received;
+        mwg_codeword_flip(&c, code.column_index[syndrome]);
+        mwg_sdecc_check(code, c, 1, legal);
+        return 1;
+    }
+
+    //Distance 2: bit j pairs with bit i iff column j == syndrome ^ column i
+    size_t num_candidates = 0;
+    for (unsigned i = 0; i < code.n; i++) {
+        int j = code.column_index[syndrome ^ code.column[i]];
+        if (j <= int(i)) continue;
+        mwg_codeword c = received;
+        mwg_codeword_flip(&c, i);
+        mwg_codeword_flip(&c, j);
+        mwg_sdecc_check(code, c, 2, legal);
+        num_candidates++;
+    }
+    if (num_candidates > 0)
+        return num_candidates;
+
+    //Distance 3, only reachable with odd-weight syndromes outside the columns
+    for (unsigned i = 0; i < code.n; i++) {
+        for (unsigned j = i + 1; j < code.n; j++) {
+            int l = code.column_index[syndrome ^ code.column[i] ^ code.column[j]];
+            if (l <= int(j)) continue;
+            mwg_codeword c = received;
+            mwg_codeword_flip(&c, i);
+            mwg_codeword_flip(&c, j);
+            mwg_codeword_flip(&c, l);
+            mwg_sdecc_check(code, c, 3, legal);
+            num_candidates++;
+        }
+    }
+    return num_candidates;
+}
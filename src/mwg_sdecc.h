@@ -0,0 +1,79 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_sdecc_h
+#define mwg_sdecc_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mwg_decode.h"
+
+#define MWG_SECDED_MAX_ROWS 8
+#define MWG_SECDED_MAX_N 128
+
+/* Codeword of up to 128 bits, bit i of the codeword is bit (i & 63) of w[i >> 6] */
+struct mwg_codeword {
+    uint64_t w[2];
+};
+
+/*
+ * Systematic SECDED code: codeword bits 0..k-1 carry the message and bits
+ * k..n-1 the parity. h[r] has bit j set iff row r of the parity-check matrix
+ * has a one in column j. Columns must be nonzero and distinct.
+ */
+struct mwg_secded_code {
+    unsigned n;
+    unsigned k;
+    unsigned rows;
+    mwg_codeword h[MWG_SECDED_MAX_ROWS];
+    uint8_t column[MWG_SECDED_MAX_N];               //syndrome of a single flip of bit j
+    int16_t column_index[1 << MWG_SECDED_MAX_ROWS]; //inverse of column, -1 if none
+};
+
+struct mwg_sdecc_candidate {
+    mwg_codeword codeword;
+    uint64_t message;
+    unsigned distance;              //Hamming distance from the received codeword
+    unsigned num_insts;             //32-bit instructions in the message
+    mwg_result insts[2];
+};
+
+/* Builds a code from n - k parity-check rows. Returns 0 on success. */
+int mwg_secded_init(mwg_secded_code *code, unsigned n, unsigned k, const mwg_codeword *h_rows);
+
+/*
+ * Builds a Hsiao (minimum odd-weight column) code: message columns are the
+ * lowest odd-weight vectors of weight >= 3 in numeric order and parity
+ * columns form the identity. Covers (39,32) and (72,64). Returns 0 on success.
+ */
+int mwg_secded_hsiao(mwg_secded_code *code, unsigned n, unsigned k);
+
+/*
+ * Reads n - k lines of n '0'/'1' characters, column j being codeword bit j,
+ * as written by MATLAB from a parity-check matrix. Returns 0 on success.
+ */
+int mwg_secded_load(mwg_secded_code *code, const char *filename, unsigned n, unsigned k);
+
+/* Returns the codeword of a k-bit message. Assumes the parity columns form the identity, as in mwg_secded_hsiao(). */
+mwg_codeword mwg_secded_encode(const mwg_secded_code &code, uint64_t message);
+
+/* Parses a codeword in hex, least significant digit holding bits 0..3. Returns 0 on success. */
+int mwg_codeword_parse(const char *hex, mwg_codeword *codeword);
+
+/* Formats an n-bit codeword as (n + 3) / 4 hex digits into buf, which needs 33 bytes */
+void mwg_codeword_format(const mwg_codeword &codeword, unsigned n, char *buf);
+
+/*
+ * Enumerates every codeword at the minimum Hamming distance (up to 3) from
+ * received, decodes each message as one (k = 32) or two (k = 64, low half
+ * first) instructions of the mwg_decode_select_isa() profile and appends the candidates whose instructions
+ * are all legal to *legal, which is cleared first. Returns the number of
+ * candidates before filtering.
+ */
+size_t mwg_sdecc_candidates(const mwg_secded_code &code, const mwg_codeword &received, std::vector<mwg_sdecc_candidate> *legal);
+
+#endif
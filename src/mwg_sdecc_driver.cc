@@ -0,0 +1,162 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_sdecc_driver.h"
+#include "mwg_work_steal.h"
+#include "mwg_stream.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//Per-worker scratch, reused across chunks
+struct mwg_sdecc_worker {
+    std::vector<mwg_sdecc_candidate> candidates;
+    uint64_t num_events;
+    uint64_t num_bad;
+};
+
+static inline bool mwg_sdecc_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+//Handles one event line [p, end) and appends its output line to buf
+static void mwg_sdecc_event(const mwg_secded_code &code, const char *p, const char *end, mwg_sdecc_worker &worker, std::vector<char> &buf) {
+    char address[32], received_hex[40];
+    const char *fields[2] = { nullptr, nullptr };
+    size_t lens[2] = { 0, 0 };
+    int num_fields = 0;
+    while (p < end) {
+        while (p < end && mwg_sdecc_space(*p)) p++;
+        if (p == end) break;
+        const char *start = p;
+        while (p < end && !mwg_sdecc_space(*p)) p++;
+        if (num_fields < 2) {
+            fields[num_fields] = start;
+            lens[num_fields] = p - start;
+        }
+        num_fields++;
+    }
+    if (num_fields == 0)
+        return;
+
+    mwg_codeword received;
+    bool ok = num_fields == 2 && lens[0] < sizeof(address) && lens[1] < sizeof(received_hex);
+    if (ok) {
+        memcpy(address, fields[0], lens[0]);
+        address[lens[0]] = '\0';
+        memcpy(received_hex, fields[1], lens[1]);
+        received_hex[lens[1]] = '\0';
+        ok = mwg_codeword_parse(received_hex, &received) == 0
+            && (code.n >= 128 || (received.w[code.n >> 6] >> (code.n & 63)) == 0)
+            && (code.n >= 64 || received.w[1] == 0);
+    }
+    worker.num_events++;
+    if (!ok) {
+        const char *line = fields[0];
+        buf.insert(buf.end(), line, end);
+        while (buf.size() > 0 && mwg_sdecc_space(buf.back())) buf.pop_back();
+        static const char error[] = " ERROR\n";
+        buf.insert(buf.end(), error, error + sizeof(error) - 1);
+        worker.num_bad++;
+        return;
+    }
+
+    size_t num_candidates = mwg_sdecc_candidates(code, received, &worker.candidates);
+
+    char line[96];
+    char codeword[33];
+    mwg_codeword_format(received, code.n, codeword);
+    int n = snprintf(line, sizeof(line), "%s %s %zu %zu", address, codeword, num_candidates, worker.candidates.size());
+    buf.insert(buf.end(), line, line + n);
+    for (auto &c : worker.candidates) {
+        n = snprintf(line, sizeof(line), " %0*llx:%s", int(code.k / 4), (unsigned long long)c.message, c.insts[0].mnemonic);
+        buf.insert(buf.end(), line, line + n);
+        for (unsigned i = 1; i < c.num_insts; i++) {
+            n = snprintf(line, sizeof(line), "+%s", c.insts[i].mnemonic);
+            buf.insert(buf.end(), line, line + n);
+        }
+    }
+    buf.push_back('\n');
+}
+
+//Processes the lines that start inside chunk
+static void mwg_sdecc_chunk(const mwg_secded_code &code, const char *data, size_t size, uint64_t chunk, mwg_sdecc_worker &worker, std::vector<char> &buf) {
+    size_t pos = chunk * MWG_SDECC_CHUNK_SIZE;
+    size_t limit = std::min(size, pos + MWG_SDECC_CHUNK_SIZE);
+    while (pos > 0 && pos < size && data[pos - 1] != '\n')
+        pos++;
+    while (pos < limit) {
+        const char *nl = (const char*)memchr(data + pos, '\n', size - pos);
+        size_t line_end = nl ? nl - data : size;
+        mwg_sdecc_event(code, data + pos, data + line_end, worker, buf);
+        pos = line_end + 1;
+    }
+}
+
+int mwg_sdecc_run_events(const mwg_secded_code &code, const char *filename, int out_fd, unsigned num_threads, mwg_sdecc_driver_stats *stats) {
+    stats->num_events = 0;
+    stats->num_bad = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error open: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) < 0) {
+        fprintf(stderr, "error fstat: %s: %s\n", filename, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    size_t size = stat_buf.st_size;
+    if (size == 0) {
+        close(fd);
+        return 0;
+    }
+    const char *data = (const char*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "error mmap: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    num_threads = mwg_work_steal_threads(num_threads);
+    uint64_t num_chunks = (size + MWG_SDECC_CHUNK_SIZE - 1) / MWG_SDECC_CHUNK_SIZE;
+    uint64_t window = uint64_t(num_threads) * MWG_SDECC_WINDOW_PER_THREAD;
+
+    std::vector<mwg_sdecc_worker> workers(num_threads);
+    std::vector<std::vector<char>> bufs(num_threads);
+    for (unsigned t = 0; t < num_threads; t++) {
+        workers[t].num_events = 0;
+        workers[t].num_bad = 0;
+        bufs[t].reserve(MWG_SDECC_CHUNK_SIZE * 4);
+    }
+
+    mwg_out_buffer out(out_fd);
+    mwg_out_reorder<std::vector<char>> reorder(out, window);
+    mwg_work_ordered_for(num_chunks, num_threads, [&](unsigned t, uint64_t chunk) {
+        mwg_sdecc_chunk(code, data, size, chunk, workers[t], bufs[t]);
+        reorder.finish(chunk, bufs[t]);
+    });
+    out.flush();
+    munmap((void*)data, size);
+
+    for (auto &worker : workers) {
+        stats->num_events += worker.num_events;
+        stats->num_bad += worker.num_bad;
+    }
+    return out.error ? 1 : 0;
+}
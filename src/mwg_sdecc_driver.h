@@ -0,0 +1,39 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_sdecc_driver_h
+#define mwg_sdecc_driver_h
+
+#include <cstdint>
+
+#include "mwg_sdecc.h"
+
+#define MWG_SDECC_CHUNK_SIZE (size_t(64) << 10)
+#define MWG_SDECC_WINDOW_PER_THREAD 16
+
+struct mwg_sdecc_driver_stats {
+    uint64_t num_events;
+    uint64_t num_bad;
+};
+
+/*
+ * Runs mwg_sdecc_candidates() over an event file with one event per line:
+ *
+ *   <address hex> <received codeword hex>
+ *
+ * and writes one line per event, in input order, to out_fd:
+ *
+ *   <address> <received> <candidates> <legal> [<message>:<mnemonic>[+<mnemonic>] ...]
+ *
+ * Malformed lines come out as "<line> ERROR". The file is mapped and cut
+ * into 64 KiB line-aligned chunks that num_threads workers (0 = one per
+ * core) take in file order from one pool, each with its own candidate and
+ * output buffers. A reorder buffer writes finished chunks in order; a
+ * worker that gets num_threads * MWG_SDECC_WINDOW_PER_THREAD chunks ahead
+ * of the oldest unwritten chunk waits for it. Returns 0 on success.
+ */
+int mwg_sdecc_run_events(const mwg_secded_code &code, const char *filename, int out_fd, unsigned num_threads, mwg_sdecc_driver_stats *stats);
+
+#endif
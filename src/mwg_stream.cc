@@ -0,0 +1,181 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_stream.h"
+#include "mwg_decode.h"
+
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+
+//Longest record: 8 + 2 + 16 + 9 + 4 x 5 + 19 + 19 spaces and digits, rounded up
+#define MWG_STREAM_RECORD_MAX 128
+
+static const char mwg_hex_digits[] = "0123456789abcdef";
+
+void mwg_out_buffer::flush() {
+    size_t done = 0;
+    while (done < len && !error) {
+        ssize_t n = write(fd, buf.data() + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("write");
+            error = true;
+        } else {
+            done += n;
+        }
+    }
+    len = 0;
+}
+
+static inline char *mwg_put_str(char *p, const char *s) {
+    while (*s)
+        *p++ = *s++;
+    return p;
+}
+
+static inline char *mwg_put_hex(char *p, uint64_t value, int digits) {
+    for (int i = digits - 1; i >= 0; i--)
+        *p++ = mwg_hex_digits[(value >> (i * 4)) & 0xf];
+    return p;
+}
+
+static inline char *mwg_put_dec(char *p, unsigned value) {
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n)
+        *p++ = tmp[--n];
+    return p;
+}
+
+//Parses one line into raw. Returns 1 for a 32-bit hex word, 0 for a blank line, -1 otherwise.
+static int mwg_parse_hex(const char *p, const char *end, uint32_t *raw) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    if (p == end)
+        return 0;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        p += 2;
+    if (end - p > 8)
+        return -1;
+    uint32_t value = 0;
+    for (; p < end; p++) {
+        char c = *p;
+        uint32_t digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return -1;
+        value = (value << 4) | digit;
+    }
+    *raw = value;
+    return 1;
+}
+
+static void mwg_stream_record(mwg_out_buffer &out, uint32_t raw) {
+    mwg_result r;
+    mwg_decode_word(raw, &r);
+
+    char *start = out.reserve(MWG_STREAM_RECORD_MAX);
+    char *p = mwg_put_hex(start, raw, 8);
+    *p++ = ' ';
+    *p++ = r.legal ? '1' : '0';
+    *p++ = ' ';
+    p = mwg_put_str(p, r.mnemonic ? r.mnemonic : "NA");
+    *p++ = ' ';
+    p = mwg_put_str(p, r.codec_name);
+    const char *regs[4] = { r.rd_name, r.rs1_name, r.rs2_name, r.rs3_name };
+    for (int i = 0; i < 4; i++) {
+        *p++ = ' ';
+        p = mwg_put_str(p, regs[i] ? regs[i] : "NA");
+    }
+    *p++ = ' ';
+    if (r.has_imm) {
+        *p++ = '0';
+        *p++ = 'x';
+        p = mwg_put_hex(p, r.imm, 16);
+    } else {
+        p = mwg_put_str(p, "NA");
+    }
+    *p++ = ' ';
+    p = r.has_arg ? mwg_put_dec(p, r.arg) : mwg_put_str(p, "NA");
+    *p++ = '\n';
+    out.commit(p - start);
+}
+
+uint64_t mwg_stream_decode(int in_fd, const char *in_name, mwg_out_buffer &out, uint64_t *num_bad) {
+    std::vector<char> in(MWG_STREAM_IN_SIZE);
+    size_t have = 0;
+    uint64_t line = 0, num_words = 0;
+    bool eof = false, skip_line = false;
+
+    while (!eof || have > 0) {
+        if (!eof) {
+            ssize_t n = read(in_fd, in.data() + have, in.size() - have);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                perror(in_name);
+                (*num_bad)++;
+                break;
+            }
+            if (n == 0)
+                eof = true;
+            have += n;
+        }
+
+        //Drop the rest of a line that was too long, up to and including its newline
+        if (skip_line) {
+            const char *nl = (const char*)memchr(in.data(), '\n', have);
+            if (!nl) {
+                have = 0;
+                continue;
+            }
+            skip_line = false;
+            have -= nl + 1 - in.data();
+            memmove(in.data(), nl + 1, have);
+        }
+
+        //Decode every complete line; at end of input the remainder counts as a line
+        const char *p = in.data(), *end = in.data() + have;
+        for (;;) {
+            const char *nl = (const char*)memchr(p, '\n', end - p);
+            if (!nl) {
+                if (!eof || p == end)
+                    break;
+                nl = end;
+            }
+            line++;
+            uint32_t raw;
+            int parsed = mwg_parse_hex(p, nl, &raw);
+            if (parsed > 0) {
+                mwg_stream_record(out, raw);
+                num_words++;
+            } else if (parsed < 0) {
+                fprintf(stderr, "%s:%llu: not a 32-bit hex word\n", in_name, (unsigned long long)line);
+                (*num_bad)++;
+            }
+            p = nl < end ? nl + 1 : end;
+        }
+
+        //Keep the partial line; one that fills the whole buffer is garbage
+        have = end - p;
+        memmove(in.data(), p, have);
+        if (have == in.size()) {
+            line++;
+            fprintf(stderr, "%s:%llu: line too long\n", in_name, (unsigned long long)line);
+            (*num_bad)++;
+            have = 0;
+            skip_line = true;
+        }
+    }
+
+    return num_words;
+}
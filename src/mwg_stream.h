@@ -0,0 +1,124 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_stream_h
+#define mwg_stream_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#define MWG_STREAM_OUT_SIZE (size_t(4) << 20)
+#define MWG_STREAM_IN_SIZE (size_t(1) << 20)
+
+/*
+ * Output buffer over a file descriptor. Records are appended in memory and
+ * written out with one write() whenever less than a record's worth of room
+ * is left, so output goes out in large blocks.
+ */
+struct mwg_out_buffer {
+    int fd;
+    std::vector<char> buf;
+    size_t len;
+    bool error;
+
+    mwg_out_buffer(int fd, size_t size = MWG_STREAM_OUT_SIZE) : fd(fd), buf(size), len(0), error(false) {}
+    ~mwg_out_buffer() { flush(); }
+
+    //Makes room for n more bytes, flushing if needed
+    char *reserve(size_t n) {
+        if (len + n > buf.size())
+            flush();
+        return buf.data() + len;
+    }
+    void commit(size_t n) { len += n; }
+    void append(const char *s, size_t n) {
+        for (; n > buf.size(); s += buf.size(), n -= buf.size())
+            append(s, buf.size());
+        memcpy(reserve(n), s, n);
+        commit(n);
+    }
+    void flush();
+};
+
+/*
+ * Puts the output of chunks finished out of order back in order. A chunk
+ * waits in a ring of window slots until every earlier chunk is done; a
+ * worker whose chunk is a whole window ahead of the oldest unwritten one
+ * blocks in finish() until a slot frees up. Whichever worker completes the
+ * run at the head takes those slots out under the lock and appends them to
+ * out after releasing it, so workers only contend for the slot swap. B is
+ * a contiguous char container such as std::vector<char> or std::string.
+ */
+template <typename B>
+struct mwg_out_reorder {
+    std::mutex lock;
+    std::condition_variable space;
+    mwg_out_buffer &out;
+    uint64_t next;                          //next chunk to write
+    bool writing;                           //a worker is appending to out
+    std::vector<B> slots;                   //chunk c waits in slots[c % window]
+    std::vector<bool> ready;
+    std::vector<B> spare;                   //written buffers, handed back to workers
+
+    mwg_out_reorder(mwg_out_buffer &out, size_t window) : out(out), next(0), writing(false), slots(window), ready(window) {}
+
+    //Swaps the chunk's output in, so the worker gets an empty buffer back, reusing a written one when there is one
+    void finish(uint64_t chunk, B &buf) {
+        std::unique_lock<std::mutex> guard(lock);
+        space.wait(guard, [&] { return chunk - next < slots.size(); });
+        size_t slot = chunk % slots.size();
+        slots[slot].swap(buf);
+        ready[slot] = true;
+        if (spare.size() > 0) {
+            buf.swap(spare.back());
+            spare.pop_back();
+        }
+        buf.clear();
+        if (writing)
+            return;
+
+        writing = true;
+        std::vector<B> done;
+        for (;;) {
+            for (size_t head; ready[head = next % slots.size()]; next++) {
+                done.emplace_back();
+                done.back().swap(slots[head]);
+                ready[head] = false;
+            }
+            if (done.empty())
+                break;
+            space.notify_all();
+            guard.unlock();
+            for (auto &b : done)
+                out.append(b.data(), b.size());
+            guard.lock();
+            for (auto &b : done) {
+                b.clear();
+                spare.push_back(std::move(b));
+            }
+            done.clear();
+        }
+        writing = false;
+    }
+};
+
+/*
+ * Reads newline-separated hex words (optional 0x prefix, surrounding blanks
+ * ignored, blank lines skipped) from in_fd and writes one record per word:
+ *
+ *   <word> <legal> <mnemonic> <codec> <rd> <rs1> <rs2> <rs3> <imm> <arg>
+ *
+ * using the fields of mwg_decode_word() with NA for absent operands. Lines
+ * that are not a 32-bit hex word are reported on stderr and counted in
+ * *num_bad. Returns the number of words decoded.
+ */
+uint64_t mwg_stream_decode(int in_fd, const char *in_name, mwg_out_buffer &out, uint64_t *num_bad);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_text.h"
+#include "mwg_decode.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-elf.h"
+#include "riscv-elf-file.h"
+#include "riscv-elf-image.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+
+#define MWG_TEXT_BATCH 4096
+
+//Read-only mapping of a whole file
+struct mwg_text_map {
+    const uint8_t *data;
+    size_t size;
+};
+
+static int mwg_text_map_file(const char *filename, mwg_text_map *map) {
+    map->data = nullptr;
+    map->size = 0;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error open: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) < 0) {
+        fprintf(stderr, "error fstat: %s: %s\n", filename, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    map->size = stat_buf.st_size;
+    if (map->size > 0) {
+        void *data = mmap(nullptr, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "error mmap: %s: %s\n", filename, strerror(errno));
+            close(fd);
+            return 1;
+        }
+        madvise(data, map->size, MADV_SEQUENTIAL);
+        map->data = (const uint8_t*)data;
+    }
+    close(fd);
+    return 0;
+}
+
+static void mwg_text_unmap_file(mwg_text_map *map) {
+    if (map->data)
+        munmap((void*)map->data, map->size);
+    map->data = nullptr;
+}
+
+static void mwg_text_init(mwg_text_stats *stats) {
+    stats->census.num_words = 0;
+    stats->census.num_legal = 0;
+    stats->census.op_count.assign(riscv_op_c_sdsp + 1, 0);
+    stats->census.codec_count.assign(riscv_codec_uj + 1, 0);
+    stats->num_compressed = 0;
+    stats->num_long = 0;
+    stats->num_sections = 0;
+}
+
+static void mwg_text_flush(mwg_census_decode_fn decode, const uint32_t *words, size_t count, mwg_text_stats *stats) {
+    uint16_t ops[MWG_TEXT_BATCH];
+    decode(words, count, ops);
+    for (size_t i = 0; i < count; i++)
+        stats->census.op_count[ops[i]]++;
+}
+
+//Walks the parcels in [pc, end), decoding in batches; a truncated parcel at the end is dropped
+static void mwg_text_walk(riscv_ptr pc, riscv_ptr end, mwg_census_decode_fn decode, mwg_text_stats *stats) {
+    uint32_t words[MWG_TEXT_BATCH];
+    size_t count = 0;
+    while (pc + 2 <= end && pc + riscv_get_instruction_length(htole16(*(uint16_t*)pc)) <= end) {
+        size_t length = riscv_get_instruction_length(htole16(*(uint16_t*)pc));
+        riscv_lu inst = riscv_get_instruction(pc, &pc);
+        stats->census.num_words++;
+        if (length > 4) {
+            stats->num_long++;
+            stats->census.op_count[riscv_op_unknown]++;
+            continue;
+        }
+        stats->num_compressed += (length == 2);
+        words[count++] = uint32_t(inst);
+        if (count == MWG_TEXT_BATCH) {
+            mwg_text_flush(decode, words, count, stats);
+            count = 0;
+        }
+    }
+    if (count > 0)
+        mwg_text_flush(decode, words, count, stats);
+}
+
+static void mwg_text_finish(mwg_text_stats *stats) {
+    for (size_t op = 0; op < stats->census.op_count.size(); op++)
+        stats->census.codec_count[riscv_instruction_codec[op]] += stats->census.op_count[op];
+    stats->census.num_legal = stats->census.num_words - stats->census.op_count[riscv_op_unknown];
+}
+
+int mwg_text_decode_blob(const char *filename, mwg_census_decode_fn decode, mwg_text_stats *stats) {
+    mwg_text_init(stats);
+    mwg_text_map map;
+    if (mwg_text_map_file(filename, &map) != 0)
+        return 1;
+    stats->num_sections = 1;
+    mwg_text_walk((riscv_ptr)map.data, (riscv_ptr)map.data + map.size, decode, stats);
+    mwg_text_unmap_file(&map);
+    mwg_text_finish(stats);
+    return 0;
+}
+
+int mwg_text_decode_elf(const char *filename, mwg_census_decode_fn decode, mwg_text_stats *stats) {
+    mwg_text_init(stats);
+
+    //Sections are views into the mapping; nothing is read up front
+    elf_file elf;
+    std::string error;
+    if (!elf.load_mmap(filename, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (!decode)
+        decode = mwg_census_isa_decoder(elf.ei_class == ELFCLASS32 ? "rv32gc" : "rv64gc");
+
+    for (size_t i = 0; i < elf.shdrs.size(); i++) {
+        const Elf64_Shdr &shdr = elf.shdrs[i];
+        if (!(shdr.sh_flags & SHF_EXECINSTR) || shdr.sh_type == SHT_NOBITS) continue;
+        riscv_ptr start = (riscv_ptr)elf.sections[i].data();
+        mwg_text_walk(start, start + elf.sections[i].length(), decode, stats);
+        stats->num_sections++;
+    }
+    mwg_text_finish(stats);
+    return 0;
+}
+
+int mwg_text_fetch(const char *filename, const char *isa, const char *const *addrs, size_t count, FILE *out) {
+    elf_file elf;
+    std::string error;
+    if (!elf.load_mmap(filename, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    elf_image image;
+    image.load(elf);
+    if (mwg_decode_select_isa(isa && isa[0] ? isa : (elf.ei_class == ELFCLASS32 ? "rv32gc" : "rv64gc")) != 0) {
+        fprintf(stderr, "error unsupported ISA profile: %s\n", isa);
+        return 1;
+    }
+
+    int retval = 0;
+    for (size_t i = 0; i < count; i++) {
+        char *end;
+        Elf64_Addr pc = strtoull(addrs[i], &end, 16);
+        riscv_lu inst;
+        if (end == addrs[i] || *end != '\0' || !image.get_instruction(pc, &inst)) {
+            fprintf(out, "%s ERROR\n", addrs[i]);
+            retval = 1;
+            continue;
+        }
+        size_t length = riscv_get_instruction_length(inst);
+        mwg_result result;
+        if (length > 4)
+            result.mnemonic = nullptr;
+        else
+            mwg_decode_word(uint32_t(inst), &result);
+        fprintf(out, "%016llx %0*llx %s\n", (unsigned long long)pc, int(length * 2), (unsigned long long)inst,
+            result.mnemonic ? result.mnemonic : "unknown");
+    }
+    return retval;
+}
+
+void mwg_text_print(const mwg_text_stats &stats, FILE *out) {
+    fprintf(out, "sections %llu compressed %llu long %llu\n", (unsigned long long)stats.num_sections,
+        (unsigned long long)stats.num_compressed, (unsigned long long)stats.num_long);
+    mwg_census_print(stats.census, out);
+}
@@ -0,0 +1,50 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_text_h
+#define mwg_text_h
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mwg_census.h"
+
+/* Instruction statistics of one binary */
+struct mwg_text_stats {
+    mwg_census_result census;   //op and codec counts over every parcel
+    uint64_t num_compressed;    //16-bit parcels
+    uint64_t num_long;          //48 and 64-bit parcels, counted as unknown ops
+    uint64_t num_sections;
+};
+
+/*
+ * Memory-maps a raw little-endian instruction blob and decodes every parcel
+ * with the given ISA decoder. Returns 0 on success.
+ */
+int mwg_text_decode_blob(const char *filename, mwg_census_decode_fn decode, mwg_text_stats *stats);
+
+/*
+ * Decodes the executable sections of an ELF in place in the elf_file::load_mmap
+ * mapping of the file, as rv32gc or rv64gc depending on the ELF class, unless a
+ * decoder is given. Returns 0 on success.
+ */
+int mwg_text_decode_elf(const char *filename, mwg_census_decode_fn decode, mwg_text_stats *stats);
+
+/*
+ * Loads the PT_LOAD segments of an ELF into an elf_image and prints the
+ * parcel at each hex guest address, one line per address:
+ *
+ *   <address> <parcel hex> <mnemonic>
+ *
+ * or "<address> ERROR" if it is not mapped or not hex. Parcels are decoded
+ * with mwg_decode_word() in the given ISA profile, rv32gc or rv64gc by ELF
+ * class if none. Returns 0 if every address was fetched.
+ */
+int mwg_text_fetch(const char *filename, const char *isa, const char *const *addrs, size_t count, FILE *out);
+
+/* Prints the statistics in the format of mwg_census_print() plus parcel counts */
+void mwg_text_print(const mwg_text_stats &stats, FILE *out);
+
+#endif
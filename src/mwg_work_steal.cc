@@ -0,0 +1,102 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#include "mwg_work_steal.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+//Remaining items of one worker, padded so neighbouring workers do not share a line
+struct alignas(64) mwg_work_steal_range {
+    std::mutex lock;
+    uint64_t begin;
+    uint64_t end;
+};
+
+unsigned mwg_work_steal_threads(unsigned num_threads) {
+    if (num_threads == 0)
+        num_threads = std::thread::hardware_concurrency();
+    return std::max(1U, num_threads);
+}
+
+static bool mwg_work_steal_take(mwg_work_steal_range &range, uint64_t *item) {
+    std::lock_guard<std::mutex> guard(range.lock);
+    if (range.begin == range.end)
+        return false;
+    *item = range.begin++;
+    return true;
+}
+
+static bool mwg_work_steal_steal(std::vector<mwg_work_steal_range> &ranges, unsigned thief) {
+    unsigned num_threads = ranges.size();
+    for (unsigned i = 1; i < num_threads; i++) {
+        mwg_work_steal_range &victim = ranges[(thief + i) % num_threads];
+        uint64_t begin, end;
+        {
+            std::lock_guard<std::mutex> guard(victim.lock);
+            uint64_t remaining = victim.end - victim.begin;
+            if (remaining == 0)
+                continue;
+            end = victim.end;
+            begin = end - (remaining + 1) / 2;
+            victim.end = begin;
+        }
+        std::lock_guard<std::mutex> guard(ranges[thief].lock);
+        ranges[thief].begin = begin;
+        ranges[thief].end = end;
+        return true;
+    }
+    return false;
+}
+
+void mwg_work_steal_for(uint64_t num_items, unsigned num_threads, const std::function<void(unsigned, uint64_t)> &fn) {
+    num_threads = mwg_work_steal_threads(num_threads);
+    if (num_threads > num_items)
+        num_threads = std::max<uint64_t>(1, num_items);
+
+    std::vector<mwg_work_steal_range> ranges(num_threads);
+    for (unsigned t = 0; t < num_threads; t++) {
+        ranges[t].begin = num_items * t / num_threads;
+        ranges[t].end = num_items * (t + 1) / num_threads;
+    }
+
+    //Once every slice is empty no new work can appear, so a failed steal pass means done
+    auto worker = [&](unsigned t) {
+        uint64_t item;
+        do {
+            while (mwg_work_steal_take(ranges[t], &item))
+                fn(t, item);
+        } while (mwg_work_steal_steal(ranges, t));
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; t++)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void mwg_work_ordered_for(uint64_t num_items, unsigned num_threads, const std::function<void(unsigned, uint64_t)> &fn) {
+    num_threads = mwg_work_steal_threads(num_threads);
+    if (num_threads > num_items)
+        num_threads = std::max<uint64_t>(1, num_items);
+
+    std::atomic<uint64_t> next_item(0);
+    auto worker = [&](unsigned t) {
+        for (uint64_t item; (item = next_item.fetch_add(1)) < num_items; )
+            fn(t, item);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; t++)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (auto &thread : threads)
+        thread.join();
+}
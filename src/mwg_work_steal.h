@@ -0,0 +1,32 @@
+/*
+ * Author: Mark Gottscho
+ * Email: mgottscho@ucla.edu
+ */
+
+#ifndef mwg_work_steal_h
+#define mwg_work_steal_h
+
+#include <cstdint>
+#include <functional>
+
+/*
+ * Runs fn(thread, item) for every item in [0, num_items) on num_threads
+ * workers (0 = one per core). Each worker starts on a contiguous slice and
+ * walks it front to back; a worker that runs dry steals the back half of
+ * another worker's remaining slice. Returns once every item has run.
+ */
+void mwg_work_steal_for(uint64_t num_items, unsigned num_threads, const std::function<void(unsigned, uint64_t)> &fn);
+
+/*
+ * Runs fn(thread, item) for every item in [0, num_items) on num_threads
+ * workers (0 = one per core) that take items in increasing order from a
+ * shared counter, so no item starts before every earlier one has. Suits
+ * output that must come out in item order through an mwg_out_reorder,
+ * whose window then bounds how far ahead of the slowest item workers run.
+ */
+void mwg_work_ordered_for(uint64_t num_items, unsigned num_threads, const std::function<void(unsigned, uint64_t)> &fn);
+
+/* Resolves 0 to one thread per core */
+unsigned mwg_work_steal_threads(unsigned num_threads);
+
+#endif
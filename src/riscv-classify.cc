@@ -0,0 +1,194 @@
+//
+//  riscv-classify.cc
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RISCV_CLASSIFY_X86 1
+#endif
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-decode-table.h"
+#include "riscv-profile.h"
+#include "riscv-classify.h"
+
+typedef riscv_opcode_table<riscv_profile_rv64g::isa> riscv_classify_table;
+
+static const riscv_classify_table &rv64g_table =
+	riscv_opcode_table_instance<riscv_profile_rv64g::isa>::table;
+
+static_assert(sizeof(riscv_opcode_node) == 8, "kernels gather riscv_opcode_node as two dwords");
+static_assert(sizeof(riscv_codec) == 4, "kernels gather riscv_instruction_codec as dwords");
+
+/* Resolve a second level entry that points into the link list */
+
+static inline riscv_hu riscv_classify_link(const riscv_classify_table &table, riscv_wu inst, riscv_hu op)
+{
+	const riscv_opcode_link *l = table.link + (op & ~riscv_opcode_link_flag);
+	while ((inst & l->mask) != l->match) l++;
+	return l->op;
+}
+
+static inline riscv_hu riscv_classify_op(const riscv_classify_table &table, riscv_wu inst)
+{
+	const riscv_opcode_node &n = table.node[riscv_opcode_major(inst)];
+	riscv_hu op = table.entry[n.base + (((inst >> n.shift1) & n.mask1) | ((inst >> n.shift2) & n.mask2))];
+	return (op & riscv_opcode_link_flag) ? riscv_classify_link(table, inst, op) : op;
+}
+
+static void riscv_classify_rv64g_scalar(const riscv_wu *inst, size_t count, riscv_bu *legal, riscv_bu *codec)
+{
+	for (size_t i = 0; i < count; i++) {
+		riscv_hu op = riscv_classify_op(rv64g_table, inst[i]);
+		legal[i] = op != riscv_op_unknown;
+		codec[i] = riscv_instruction_codec[op];
+	}
+}
+
+#if RISCV_CLASSIFY_X86
+
+__attribute__((target("sse4.2")))
+static void riscv_classify_rv64g_sse42(const riscv_wu *inst, size_t count, riscv_bu *legal, riscv_bu *codec)
+{
+	const riscv_classify_table &table = rv64g_table;
+	const __m128i c3 = _mm_set1_epi32(3), c7 = _mm_set1_epi32(7), c31 = _mm_set1_epi32(31), c24 = _mm_set1_epi32(24);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i w = _mm_loadu_si128((const __m128i*)(inst + i));
+		__m128i q = _mm_and_si128(w, c3);
+		__m128i major32 = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(w, 2), c31), c24);
+		__m128i major16 = _mm_or_si128(_mm_slli_epi32(q, 3), _mm_and_si128(_mm_srli_epi32(w, 13), c7));
+		__m128i major = _mm_blendv_epi8(major16, major32, _mm_cmpeq_epi32(q, c3));
+
+		// no gathers or variable shifts before AVX2, so the lookups are per lane
+		alignas(16) riscv_wu m[4], op[4];
+		_mm_store_si128((__m128i*)m, major);
+		for (size_t j = 0; j < 4; j++) {
+			const riscv_opcode_node &n = table.node[m[j]];
+			riscv_wu w = inst[i + j];
+			riscv_hu e = table.entry[n.base + (((w >> n.shift1) & n.mask1) | ((w >> n.shift2) & n.mask2))];
+			op[j] = (e & riscv_opcode_link_flag) ? riscv_classify_link(table, w, e) : e;
+			codec[i + j] = riscv_instruction_codec[op[j]];
+		}
+		__m128i ops = _mm_load_si128((const __m128i*)op);
+		__m128i ok = _mm_andnot_si128(_mm_cmpeq_epi32(ops, _mm_setzero_si128()), _mm_set1_epi32(1));
+		ok = _mm_shuffle_epi8(ok, _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+		riscv_wu ok4 = _mm_cvtsi128_si32(ok);
+		memcpy(legal + i, &ok4, 4);
+	}
+	riscv_classify_rv64g_scalar(inst + i, count - i, legal + i, codec + i);
+}
+
+__attribute__((target("avx2")))
+static void riscv_classify_rv64g_avx2(const riscv_wu *inst, size_t count, riscv_bu *legal, riscv_bu *codec)
+{
+	const riscv_classify_table &table = rv64g_table;
+	const int *node = (const int*)table.node;
+	const int *entry = (const int*)table.entry;
+	const int *codec_table = (const int*)riscv_instruction_codec;
+	const __m256i c3 = _mm256_set1_epi32(3), c7 = _mm256_set1_epi32(7), c31 = _mm256_set1_epi32(31);
+	const __m256i c24 = _mm256_set1_epi32(24), c255 = _mm256_set1_epi32(0xff), c65535 = _mm256_set1_epi32(0xffff);
+	const __m256i link_flag = _mm256_set1_epi32(riscv_opcode_link_flag);
+	const __m256i low_bytes = _mm256_setr_epi8(
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i w = _mm256_loadu_si256((const __m256i*)(inst + i));
+
+		// first level: major opcode, or quadrant and funct3 for compressed words
+		__m256i q = _mm256_and_si256(w, c3);
+		__m256i major32 = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(w, 2), c31), c24);
+		__m256i major16 = _mm256_or_si256(_mm256_slli_epi32(q, 3), _mm256_and_si256(_mm256_srli_epi32(w, 13), c7));
+		__m256i major = _mm256_blendv_epi8(major16, major32, _mm256_cmpeq_epi32(q, c3));
+
+		// node dword 0 is base | mask1 << 16, dword 1 is mask2 | shift1 << 16 | shift2 << 24
+		__m256i n0 = _mm256_i32gather_epi32(node, major, 8);
+		__m256i n1 = _mm256_i32gather_epi32(node + 1, major, 8);
+		__m256i base = _mm256_and_si256(n0, c65535);
+		__m256i mask1 = _mm256_srli_epi32(n0, 16);
+		__m256i mask2 = _mm256_and_si256(n1, c65535);
+		__m256i shift1 = _mm256_and_si256(_mm256_srli_epi32(n1, 16), c255);
+		__m256i shift2 = _mm256_srli_epi32(n1, 24);
+
+		// second level: the entry is a riscv_hu, so gather a dword and keep the low half
+		__m256i key = _mm256_or_si256(
+			_mm256_and_si256(_mm256_srlv_epi32(w, shift1), mask1),
+			_mm256_and_si256(_mm256_srlv_epi32(w, shift2), mask2));
+		__m256i op = _mm256_and_si256(_mm256_i32gather_epi32(entry, _mm256_add_epi32(base, key), 2), c65535);
+
+		// rare: entries that still depend on rs1/rs2/rd/csr
+		int links = _mm256_movemask_ps(_mm256_castsi256_ps(
+			_mm256_cmpeq_epi32(_mm256_and_si256(op, link_flag), link_flag)));
+		if (links) {
+			alignas(32) riscv_wu ops[8];
+			_mm256_store_si256((__m256i*)ops, op);
+			for (size_t j = 0; j < 8; j++) {
+				if (links & (1 << j)) ops[j] = riscv_classify_link(table, inst[i + j], ops[j]);
+			}
+			op = _mm256_load_si256((const __m256i*)ops);
+		}
+
+		__m256i cod = _mm256_i32gather_epi32(codec_table, op, 4);
+		__m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi32(op, _mm256_setzero_si256()), _mm256_set1_epi32(1));
+		cod = _mm256_shuffle_epi8(cod, low_bytes);
+		ok = _mm256_shuffle_epi8(ok, low_bytes);
+		riscv_wu out[4] = {
+			riscv_wu(_mm256_extract_epi32(ok, 0)), riscv_wu(_mm256_extract_epi32(ok, 4)),
+			riscv_wu(_mm256_extract_epi32(cod, 0)), riscv_wu(_mm256_extract_epi32(cod, 4))
+		};
+		memcpy(legal + i, out, 8);
+		memcpy(codec + i, out + 2, 8);
+	}
+	riscv_classify_rv64g_scalar(inst + i, count - i, legal + i, codec + i);
+}
+
+#endif
+
+riscv_simd_level riscv_simd_detect()
+{
+#if RISCV_CLASSIFY_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return riscv_simd_avx2;
+	if (__builtin_cpu_supports("sse4.2")) return riscv_simd_sse42;
+#endif
+	return riscv_simd_scalar;
+}
+
+const char* riscv_simd_level_name(riscv_simd_level level)
+{
+	switch (level) {
+		case riscv_simd_scalar: return "scalar";
+		case riscv_simd_sse42: return "sse4.2";
+		case riscv_simd_avx2: return "avx2";
+	}
+	return "unknown";
+}
+
+riscv_classify_fn riscv_classify_rv64g_kernel(riscv_simd_level level)
+{
+	switch (level) {
+#if RISCV_CLASSIFY_X86
+		case riscv_simd_avx2: return riscv_classify_rv64g_avx2;
+		case riscv_simd_sse42: return riscv_classify_rv64g_sse42;
+#endif
+		case riscv_simd_scalar: return riscv_classify_rv64g_scalar;
+		default: return nullptr;
+	}
+}
+
+void riscv_classify_rv64g(const riscv_wu *inst, size_t count, riscv_bu *legal, riscv_bu *codec)
+{
+	static const riscv_classify_fn fn = riscv_classify_rv64g_kernel(riscv_simd_detect());
+	fn(inst, count, legal, codec);
+}
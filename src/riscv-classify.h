@@ -0,0 +1,36 @@
+//
+//  riscv-classify.h
+//
+
+#ifndef riscv_classify_h
+#define riscv_classify_h
+
+/* SIMD Levels */
+
+enum riscv_simd_level
+{
+	riscv_simd_scalar,
+	riscv_simd_sse42,
+	riscv_simd_avx2
+};
+
+/*
+ * Legality Classifier
+ *
+ * Writes legal[i] = 1 and codec[i] = riscv_instruction_codec[op] for every
+ * word riscv_decode_opcode accepts as RV64G, or legal[i] = 0 and
+ * codec[i] = riscv_codec_unknown otherwise, using the rv64g two-level table
+ * of riscv-decode-table.h. The AVX2 kernel classifies 8 words per iteration
+ * with gathers into the table. SSE4.2 has neither gathers nor per-lane
+ * shifts, so its kernel takes 4 words per iteration, vectorising only the
+ * major opcode and the legal bytes, and looks each lane up in scalar code.
+ */
+
+typedef void (*riscv_classify_fn)(const riscv_wu *inst, size_t count, riscv_bu *legal, riscv_bu *codec);
+
+riscv_simd_level riscv_simd_detect();
+const char* riscv_simd_level_name(riscv_simd_level level);
+riscv_classify_fn riscv_classify_rv64g_kernel(riscv_simd_level level);
+void riscv_classify_rv64g(const riscv_wu *inst, size_t count, riscv_bu *legal, riscv_bu *codec);
+
+#endif
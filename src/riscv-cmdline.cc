@@ -14,6 +14,7 @@ const char* cmdline_option::arg_types[] =
 {
 	"",
 	"<int>",
+	"<hex>",
 	"<string>"
 };
 
@@ -9,6 +9,7 @@ enum cmdline_arg_type
 {
 	cmdline_arg_type_none,
 	cmdline_arg_type_int,
+	cmdline_arg_type_hex,
 	cmdline_arg_type_string
 };
 
@@ -0,0 +1,47 @@
+//
+//  riscv-decode-cache.cc
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-decode-cache.h"
+
+riscv_decode_cache::riscv_decode_cache(riscv_decode_fn decode_fn, size_t num_entries)
+	: decode_fn(decode_fn), set_mask(0), hits(0), misses(0)
+{
+	size_t num_sets = 1;
+	while (num_sets * riscv_decode_cache_ways < num_entries) num_sets <<= 1;
+	set_mask = num_sets - 1;
+	sets.resize(num_sets);
+	clear();
+}
+
+void riscv_decode_cache::clear()
+{
+	riscv_decode zero = riscv_decode();
+	decode_fn(zero, 0);
+	riscv_decode_cache_set set;
+	std::fill(set.inst, set.inst + riscv_decode_cache_ways, 0);
+	std::fill(set.dec, set.dec + riscv_decode_cache_ways, zero);
+	std::fill(sets.begin(), sets.end(), set);
+	hits = misses = 0;
+}
+
+void riscv_decode_cache::decode_miss(riscv_decode_cache_set &set, riscv_decode &dec, riscv_lu inst)
+{
+	size_t way = misses++ % riscv_decode_cache_ways;
+	dec = riscv_decode();
+	decode_fn(dec, inst);
+	set.inst[way] = inst;
+	set.dec[way] = dec;
+}
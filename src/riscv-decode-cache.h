@@ -0,0 +1,70 @@
+//
+//  riscv-decode-cache.h
+//
+
+#ifndef riscv_decode_cache_h
+#define riscv_decode_cache_h
+
+/*
+ * Decode Cache
+ *
+ * Set-associative memo of riscv_decode records keyed by the raw instruction
+ * word, for traces that repeat a small set of words many times. A set keeps
+ * its riscv_decode_cache_ways tags together so a lookup touches one cache
+ * line for the tags; misses replace a way chosen by the miss counter. The
+ * cache has no locks, so each thread owns its own instance.
+ *
+ * Every way starts out holding the decode of word 0, so the lookup needs no
+ * valid bits and an entry is never wrong, only possibly cold.
+ */
+
+typedef void (*riscv_decode_fn)(riscv_decode &dec, riscv_lu inst);
+
+enum { riscv_decode_cache_ways = 4 };
+
+struct riscv_decode_cache_set
+{
+	riscv_lu inst[riscv_decode_cache_ways];
+	riscv_decode dec[riscv_decode_cache_ways];
+};
+
+struct riscv_decode_cache
+{
+	riscv_decode_fn decode_fn;
+	std::vector<riscv_decode_cache_set> sets;
+	size_t set_mask;
+	riscv_lu hits;
+	riscv_lu misses;
+
+	/* num_entries is rounded up to a power of two of at least riscv_decode_cache_ways */
+	riscv_decode_cache(riscv_decode_fn decode_fn, size_t num_entries);
+
+	size_t size() const { return sets.size() * riscv_decode_cache_ways; }
+	void clear();
+
+	inline size_t set_index(riscv_lu inst) const
+	{
+		inst = (inst ^ (inst >> 29)) * 0xbf58476d1ce4e5b9ULL;
+		return (inst ^ (inst >> 32)) & set_mask;
+	}
+
+	inline void decode(riscv_decode &dec, riscv_lu inst)
+	{
+		riscv_decode_cache_set &set = sets[set_index(inst)];
+		/* compare every tag without branching, so lookups overlap in the pipeline */
+		unsigned match = 0;
+		for (size_t way = 0; way < riscv_decode_cache_ways; way++) {
+			match |= unsigned(set.inst[way] == inst) << way;
+		}
+		if (match == 0) {
+			decode_miss(set, dec, inst);
+			return;
+		}
+		hits++;
+		dec = set.dec[__builtin_ctz(match)];
+	}
+
+	void decode_miss(riscv_decode_cache_set &set, riscv_decode &dec, riscv_lu inst);
+};
+
+#endif
@@ -0,0 +1,520 @@
+//
+//  riscv-decode-table.h
+//
+
+#ifndef riscv_decode_table_h
+#define riscv_decode_table_h
+
+/* ISA subset flags */
+
+enum riscv_isa_flag
+{
+	riscv_isa_rv32 = 1 << 0,
+	riscv_isa_rv64 = 1 << 1,
+	riscv_isa_rvi  = 1 << 2,
+	riscv_isa_rvm  = 1 << 3,
+	riscv_isa_rva  = 1 << 4,
+	riscv_isa_rvs  = 1 << 5,
+	riscv_isa_rvf  = 1 << 6,
+	riscv_isa_rvd  = 1 << 7,
+	riscv_isa_rvc  = 1 << 8,
+};
+
+template <bool rv32, bool rv64, bool rvi, bool rvm, bool rva, bool rvs, bool rvf, bool rvd, bool rvc>
+constexpr riscv_hu riscv_isa_flags()
+{
+	return (rv32 ? riscv_isa_rv32 : 0) | (rv64 ? riscv_isa_rv64 : 0) |
+		(rvi ? riscv_isa_rvi : 0) | (rvm ? riscv_isa_rvm : 0) | (rva ? riscv_isa_rva : 0) |
+		(rvs ? riscv_isa_rvs : 0) | (rvf ? riscv_isa_rvf : 0) | (rvd ? riscv_isa_rvd : 0) |
+		(rvc ? riscv_isa_rvc : 0);
+}
+
+/*
+ * Opcode rules
+ *
+ * mask and match mirror riscv_instruction_mask and riscv_instruction_match,
+ * isa holds the extensions riscv_decode_opcode requires for each opcode.
+ * The meta arrays are not constexpr, so the pairs are copied here; rv64gbench
+ * fails if any pair differs or an opcode has no rule.
+ * When several rules match a word, the rule with the most mask bits wins,
+ * then the rule listed first; this reproduces the nested switch. A rule whose
+ * extensions are off still wins and decodes as riscv_op_unknown, as the
+ * switch case does, unless an enabled rule has the same mask and match.
+ */
+
+struct riscv_opcode_rule
+{
+	riscv_hu op;
+	riscv_hu isa;
+	riscv_wu mask;
+	riscv_wu match;
+};
+
+constexpr riscv_opcode_rule riscv_opcode_rules[] = {
+	{ riscv_op_lui,                riscv_isa_rvi,                           0x0000007f, 0x00000037 },
+	{ riscv_op_auipc,              riscv_isa_rvi,                           0x0000007f, 0x00000017 },
+	{ riscv_op_jal,                riscv_isa_rvi,                           0x0000007f, 0x0000006f },
+	{ riscv_op_jalr,               riscv_isa_rvi,                           0x0000707f, 0x00000067 },
+	{ riscv_op_beq,                riscv_isa_rvi,                           0x0000707f, 0x00000063 },
+	{ riscv_op_bne,                riscv_isa_rvi,                           0x0000707f, 0x00001063 },
+	{ riscv_op_blt,                riscv_isa_rvi,                           0x0000707f, 0x00004063 },
+	{ riscv_op_bge,                riscv_isa_rvi,                           0x0000707f, 0x00005063 },
+	{ riscv_op_bltu,               riscv_isa_rvi,                           0x0000707f, 0x00006063 },
+	{ riscv_op_bgeu,               riscv_isa_rvi,                           0x0000707f, 0x00007063 },
+	{ riscv_op_lb,                 riscv_isa_rvi,                           0x0000707f, 0x00000003 },
+	{ riscv_op_lh,                 riscv_isa_rvi,                           0x0000707f, 0x00001003 },
+	{ riscv_op_lw,                 riscv_isa_rvi,                           0x0000707f, 0x00002003 },
+	{ riscv_op_lbu,                riscv_isa_rvi,                           0x0000707f, 0x00004003 },
+	{ riscv_op_lhu,                riscv_isa_rvi,                           0x0000707f, 0x00005003 },
+	{ riscv_op_sb,                 riscv_isa_rvi,                           0x0000707f, 0x00000023 },
+	{ riscv_op_sh,                 riscv_isa_rvi,                           0x0000707f, 0x00001023 },
+	{ riscv_op_sw,                 riscv_isa_rvi,                           0x0000707f, 0x00002023 },
+	{ riscv_op_addi,               riscv_isa_rvi,                           0x0000707f, 0x00000013 },
+	{ riscv_op_slti,               riscv_isa_rvi,                           0x0000707f, 0x00002013 },
+	{ riscv_op_sltiu,              riscv_isa_rvi,                           0x0000707f, 0x00003013 },
+	{ riscv_op_xori,               riscv_isa_rvi,                           0x0000707f, 0x00004013 },
+	{ riscv_op_ori,                riscv_isa_rvi,                           0x0000707f, 0x00006013 },
+	{ riscv_op_andi,               riscv_isa_rvi,                           0x0000707f, 0x00007013 },
+	{ riscv_op_slli_rv32i,         riscv_isa_rvi | riscv_isa_rv32,          0xfc00707f, 0x00001013 },
+	{ riscv_op_srli_rv32i,         riscv_isa_rvi | riscv_isa_rv32,          0xfc00707f, 0x00005013 },
+	{ riscv_op_srai_rv32i,         riscv_isa_rvi | riscv_isa_rv32,          0xfc00707f, 0x40005013 },
+	{ riscv_op_add,                riscv_isa_rvi,                           0xfe00707f, 0x00000033 },
+	{ riscv_op_sub,                riscv_isa_rvi,                           0xfe00707f, 0x40000033 },
+	{ riscv_op_sll,                riscv_isa_rvi,                           0xfe00707f, 0x00001033 },
+	{ riscv_op_slt,                riscv_isa_rvi,                           0xfe00707f, 0x00002033 },
+	{ riscv_op_sltu,               riscv_isa_rvi,                           0xfe00707f, 0x00003033 },
+	{ riscv_op_xor,                riscv_isa_rvi,                           0xfe00707f, 0x00004033 },
+	{ riscv_op_srl,                riscv_isa_rvi,                           0xfe00707f, 0x00005033 },
+	{ riscv_op_sra,                riscv_isa_rvi,                           0xfe00707f, 0x40005033 },
+	{ riscv_op_or,                 riscv_isa_rvi,                           0xfe00707f, 0x00006033 },
+	{ riscv_op_and,                riscv_isa_rvi,                           0xfe00707f, 0x00007033 },
+	{ riscv_op_fence,              riscv_isa_rvi,                           0x0000707f, 0x0000000f },
+	{ riscv_op_fence_i,            riscv_isa_rvi,                           0x0000707f, 0x0000100f },
+	{ riscv_op_lwu,                riscv_isa_rvi | riscv_isa_rv64,          0x0000707f, 0x00006003 },
+	{ riscv_op_ld,                 riscv_isa_rvi | riscv_isa_rv64,          0x0000707f, 0x00003003 },
+	{ riscv_op_sd,                 riscv_isa_rvi | riscv_isa_rv64,          0x0000707f, 0x00003023 },
+	{ riscv_op_slli_rv64i,         riscv_isa_rvi | riscv_isa_rv64,          0xfc00707f, 0x00001013 },
+	{ riscv_op_srli_rv64i,         riscv_isa_rvi | riscv_isa_rv64,          0xfc00707f, 0x00005013 },
+	{ riscv_op_srai_rv64i,         riscv_isa_rvi | riscv_isa_rv64,          0xfc00707f, 0x40005013 },
+	{ riscv_op_addiw,              riscv_isa_rvi | riscv_isa_rv64,          0x0000707f, 0x0000001b },
+	{ riscv_op_slliw,              riscv_isa_rvi | riscv_isa_rv64,          0xfe00707f, 0x0000101b },
+	{ riscv_op_srliw,              riscv_isa_rvi | riscv_isa_rv64,          0xfe00707f, 0x0000501b },
+	{ riscv_op_sraiw,              riscv_isa_rvi | riscv_isa_rv64,          0xfe00707f, 0x4000501b },
+	{ riscv_op_addw,               riscv_isa_rvi | riscv_isa_rv64,          0xfe00707f, 0x0000003b },
+	{ riscv_op_subw,               riscv_isa_rvi | riscv_isa_rv64,          0xfe00707f, 0x4000003b },
+	{ riscv_op_sllw,               riscv_isa_rvi | riscv_isa_rv64,          0xfe00707f, 0x0000103b },
+	{ riscv_op_srlw,               riscv_isa_rvi | riscv_isa_rv64,          0xfe00707f, 0x0000503b },
+	{ riscv_op_sraw,               riscv_isa_rvi | riscv_isa_rv64,          0xfe00707f, 0x4000503b },
+	{ riscv_op_mul,                riscv_isa_rvm,                           0xfe00707f, 0x02000033 },
+	{ riscv_op_mulh,               riscv_isa_rvm,                           0xfe00707f, 0x02001033 },
+	{ riscv_op_mulhsu,             riscv_isa_rvm,                           0xfe00707f, 0x02002033 },
+	{ riscv_op_mulhu,              riscv_isa_rvm,                           0xfe00707f, 0x02003033 },
+	{ riscv_op_div,                riscv_isa_rvm,                           0xfe00707f, 0x02004033 },
+	{ riscv_op_divu,               riscv_isa_rvm,                           0xfe00707f, 0x02005033 },
+	{ riscv_op_rem,                riscv_isa_rvm,                           0xfe00707f, 0x02006033 },
+	{ riscv_op_remu,               riscv_isa_rvm,                           0xfe00707f, 0x02007033 },
+	{ riscv_op_mulw,               riscv_isa_rvm | riscv_isa_rv64,          0xfe00707f, 0x0200003b },
+	{ riscv_op_divw,               riscv_isa_rvm | riscv_isa_rv64,          0xfe00707f, 0x0200403b },
+	{ riscv_op_divuw,              riscv_isa_rvm | riscv_isa_rv64,          0xfe00707f, 0x0200503b },
+	{ riscv_op_remw,               riscv_isa_rvm | riscv_isa_rv64,          0xfe00707f, 0x0200603b },
+	{ riscv_op_remuw,              riscv_isa_rvm | riscv_isa_rv64,          0xfe00707f, 0x0200703b },
+	{ riscv_op_lr_w,               riscv_isa_rva,                           0xf9f0707f, 0x1000202f },
+	{ riscv_op_sc_w,               riscv_isa_rva,                           0xf800707f, 0x1800202f },
+	{ riscv_op_amoswap_w,          riscv_isa_rva,                           0xf800707f, 0x0800202f },
+	{ riscv_op_amoadd_w,           riscv_isa_rva,                           0xf800707f, 0x0000202f },
+	{ riscv_op_amoxor_w,           riscv_isa_rva,                           0xf800707f, 0x2000202f },
+	{ riscv_op_amoor_w,            riscv_isa_rva,                           0xf800707f, 0x4000202f },
+	{ riscv_op_amoand_w,           riscv_isa_rva,                           0xf800707f, 0x6000202f },
+	{ riscv_op_amomin_w,           riscv_isa_rva,                           0xf800707f, 0x8000202f },
+	{ riscv_op_amomax_w,           riscv_isa_rva,                           0xf800707f, 0xa000202f },
+	{ riscv_op_amominu_w,          riscv_isa_rva,                           0xf800707f, 0xc000202f },
+	{ riscv_op_amomaxu_w,          riscv_isa_rva,                           0xf800707f, 0xe000202f },
+	{ riscv_op_lr_d,               riscv_isa_rva | riscv_isa_rv64,          0xf9f0707f, 0x1000302f },
+	{ riscv_op_sc_d,               riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0x1800302f },
+	{ riscv_op_amoswap_d,          riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0x0800302f },
+	{ riscv_op_amoadd_d,           riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0x0000302f },
+	{ riscv_op_amoxor_d,           riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0x2000302f },
+	{ riscv_op_amoor_d,            riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0x4000302f },
+	{ riscv_op_amoand_d,           riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0x6000302f },
+	{ riscv_op_amomin_d,           riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0x8000302f },
+	{ riscv_op_amomax_d,           riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0xa000302f },
+	{ riscv_op_amominu_d,          riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0xc000302f },
+	{ riscv_op_amomaxu_d,          riscv_isa_rva | riscv_isa_rv64,          0xf800707f, 0xe000302f },
+	{ riscv_op_ecall,              riscv_isa_rvs,                           0xffffffff, 0x00000073 },
+	{ riscv_op_ebreak,             riscv_isa_rvs,                           0xffffffff, 0x00100073 },
+	{ riscv_op_uret,               riscv_isa_rvs,                           0xffffffff, 0x00200073 },
+	{ riscv_op_sret,               riscv_isa_rvs,                           0xffffffff, 0x10000073 },
+	{ riscv_op_hret,               riscv_isa_rvs,                           0xffffffff, 0x20200073 },
+	{ riscv_op_mret,               riscv_isa_rvs,                           0xffffffff, 0x30200073 },
+	{ riscv_op_dret,               riscv_isa_rvs,                           0xffffffff, 0x7b200073 },
+	{ riscv_op_sfence_vm,          riscv_isa_rvs,                           0xfff07fff, 0x10100073 },
+	{ riscv_op_wfi,                riscv_isa_rvs,                           0xffffffff, 0x10200073 },
+	{ riscv_op_csrrw,              riscv_isa_rvs,                           0x0000707f, 0x00001073 },
+	{ riscv_op_csrrs,              riscv_isa_rvs,                           0x0000707f, 0x00002073 },
+	{ riscv_op_csrrc,              riscv_isa_rvs,                           0x0000707f, 0x00003073 },
+	{ riscv_op_csrrwi,             riscv_isa_rvs,                           0x0000707f, 0x00005073 },
+	{ riscv_op_csrrsi,             riscv_isa_rvs,                           0x0000707f, 0x00006073 },
+	{ riscv_op_csrrci,             riscv_isa_rvs,                           0x0000707f, 0x00007073 },
+	{ riscv_op_flw,                riscv_isa_rvf,                           0x0000707f, 0x00002007 },
+	{ riscv_op_fsw,                riscv_isa_rvf,                           0x0000707f, 0x00002027 },
+	{ riscv_op_fmadd_s,            riscv_isa_rvf,                           0x0600007f, 0x00000043 },
+	{ riscv_op_fmsub_s,            riscv_isa_rvf,                           0x0600007f, 0x00000047 },
+	{ riscv_op_fnmsub_s,           riscv_isa_rvf,                           0x0600007f, 0x0000004b },
+	{ riscv_op_fnmadd_s,           riscv_isa_rvf,                           0x0600007f, 0x0000004f },
+	{ riscv_op_fadd_s,             riscv_isa_rvf,                           0xfe00007f, 0x00000053 },
+	{ riscv_op_fsub_s,             riscv_isa_rvf,                           0xfe00007f, 0x08000053 },
+	{ riscv_op_fmul_s,             riscv_isa_rvf,                           0xfe00007f, 0x10000053 },
+	{ riscv_op_fdiv_s,             riscv_isa_rvf,                           0xfe00007f, 0x18000053 },
+	{ riscv_op_fsgnj_s,            riscv_isa_rvf,                           0xfe00707f, 0x20000053 },
+	{ riscv_op_fsgnjn_s,           riscv_isa_rvf,                           0xfe00707f, 0x20001053 },
+	{ riscv_op_fsgnjx_s,           riscv_isa_rvf,                           0xfe00707f, 0x20002053 },
+	{ riscv_op_fmin_s,             riscv_isa_rvf,                           0xfe00707f, 0x28000053 },
+	{ riscv_op_fmax_s,             riscv_isa_rvf,                           0xfe00707f, 0x28001053 },
+	{ riscv_op_fsqrt_s,            riscv_isa_rvf,                           0xfff0007f, 0x58000053 },
+	{ riscv_op_fle_s,              riscv_isa_rvf,                           0xfe00707f, 0xa0000053 },
+	{ riscv_op_flt_s,              riscv_isa_rvf,                           0xfe00707f, 0xa0001053 },
+	{ riscv_op_feq_s,              riscv_isa_rvf,                           0xfe00707f, 0xa0002053 },
+	{ riscv_op_fcvt_w_s,           riscv_isa_rvf,                           0xfff0007f, 0xc0000053 },
+	{ riscv_op_fcvt_wu_s,          riscv_isa_rvf,                           0xfff0007f, 0xc0100053 },
+	{ riscv_op_fcvt_s_w,           riscv_isa_rvf,                           0xfff0007f, 0xd0000053 },
+	{ riscv_op_fcvt_s_wu,          riscv_isa_rvf,                           0xfff0007f, 0xd0100053 },
+	{ riscv_op_fmv_x_s,            riscv_isa_rvf,                           0xfff0707f, 0xe0000053 },
+	{ riscv_op_fclass_s,           riscv_isa_rvf,                           0xfff0707f, 0xe0001053 },
+	{ riscv_op_fmv_s_x,            riscv_isa_rvf,                           0xfff0707f, 0xf0000053 },
+	{ riscv_op_fcvt_l_s,           riscv_isa_rvf | riscv_isa_rv64,          0xfff0007f, 0xc0200053 },
+	{ riscv_op_fcvt_lu_s,          riscv_isa_rvf | riscv_isa_rv64,          0xfff0007f, 0xc0300053 },
+	{ riscv_op_fcvt_s_l,           riscv_isa_rvf | riscv_isa_rv64,          0xfff0007f, 0xd0200053 },
+	{ riscv_op_fcvt_s_lu,          riscv_isa_rvf | riscv_isa_rv64,          0xfff0007f, 0xd0300053 },
+	{ riscv_op_fld,                riscv_isa_rvd,                           0x0000707f, 0x00003007 },
+	{ riscv_op_fsd,                riscv_isa_rvd,                           0x0000707f, 0x00003027 },
+	{ riscv_op_fmadd_d,            riscv_isa_rvd,                           0x0600007f, 0x02000043 },
+	{ riscv_op_fmsub_d,            riscv_isa_rvd,                           0x0600007f, 0x02000047 },
+	{ riscv_op_fnmsub_d,           riscv_isa_rvd,                           0x0600007f, 0x0200004b },
+	{ riscv_op_fnmadd_d,           riscv_isa_rvd,                           0x0600007f, 0x0200004f },
+	{ riscv_op_fadd_d,             riscv_isa_rvd,                           0xfe00007f, 0x02000053 },
+	{ riscv_op_fsub_d,             riscv_isa_rvd,                           0xfe00007f, 0x0a000053 },
+	{ riscv_op_fmul_d,             riscv_isa_rvd,                           0xfe00007f, 0x12000053 },
+	{ riscv_op_fdiv_d,             riscv_isa_rvd,                           0xfe00007f, 0x1a000053 },
+	{ riscv_op_fsgnj_d,            riscv_isa_rvd,                           0xfe00707f, 0x22000053 },
+	{ riscv_op_fsgnjn_d,           riscv_isa_rvd,                           0xfe00707f, 0x22001053 },
+	{ riscv_op_fsgnjx_d,           riscv_isa_rvd,                           0xfe00707f, 0x22002053 },
+	{ riscv_op_fmin_d,             riscv_isa_rvd,                           0xfe00707f, 0x2a000053 },
+	{ riscv_op_fmax_d,             riscv_isa_rvd,                           0xfe00707f, 0x2a001053 },
+	{ riscv_op_fcvt_s_d,           riscv_isa_rvd,                           0xfff0007f, 0x40100053 },
+	{ riscv_op_fcvt_d_s,           riscv_isa_rvd,                           0xfff0007f, 0x42000053 },
+	{ riscv_op_fsqrt_d,            riscv_isa_rvd,                           0xfff0007f, 0x5a000053 },
+	{ riscv_op_fle_d,              riscv_isa_rvd,                           0xfe00707f, 0xa2000053 },
+	{ riscv_op_flt_d,              riscv_isa_rvd,                           0xfe00707f, 0xa2001053 },
+	{ riscv_op_feq_d,              riscv_isa_rvd,                           0xfe00707f, 0xa2002053 },
+	{ riscv_op_fcvt_w_d,           riscv_isa_rvd,                           0xfff0007f, 0xc2000053 },
+	{ riscv_op_fcvt_wu_d,          riscv_isa_rvd,                           0xfff0007f, 0xc2100053 },
+	{ riscv_op_fcvt_d_w,           riscv_isa_rvd,                           0xfff0007f, 0xd2000053 },
+	{ riscv_op_fcvt_d_wu,          riscv_isa_rvd,                           0xfff0007f, 0xd2100053 },
+	{ riscv_op_fclass_d,           riscv_isa_rvd,                           0xfff0707f, 0xe2001053 },
+	{ riscv_op_fcvt_l_d,           riscv_isa_rvd | riscv_isa_rv64,          0xfff0007f, 0xc2200053 },
+	{ riscv_op_fcvt_lu_d,          riscv_isa_rvd | riscv_isa_rv64,          0xfff0007f, 0xc2300053 },
+	{ riscv_op_fmv_x_d,            riscv_isa_rvd | riscv_isa_rv64,          0xfff0707f, 0xe2000053 },
+	{ riscv_op_fcvt_d_l,           riscv_isa_rvd | riscv_isa_rv64,          0xfff0007f, 0xd2200053 },
+	{ riscv_op_fcvt_d_lu,          riscv_isa_rvd | riscv_isa_rv64,          0xfff0007f, 0xd2300053 },
+	{ riscv_op_fmv_d_x,            riscv_isa_rvd | riscv_isa_rv64,          0xfff0707f, 0xf2000053 },
+	{ riscv_op_frcsr,              riscv_isa_rvf,                           0xfffff07f, 0x00302073 },
+	{ riscv_op_frrm,               riscv_isa_rvf,                           0xfffff07f, 0x00202073 },
+	{ riscv_op_frflags,            riscv_isa_rvf,                           0xfffff07f, 0x00102073 },
+	{ riscv_op_fscsr,              riscv_isa_rvf,                           0xfff0707f, 0x00301073 },
+	{ riscv_op_fsrm,               riscv_isa_rvf,                           0xfff0707f, 0x00201073 },
+	{ riscv_op_fsflags,            riscv_isa_rvf,                           0xfff0707f, 0x00101073 },
+	{ riscv_op_fsrmi,              riscv_isa_rvf,                           0xfff0707f, 0x00205073 },
+	{ riscv_op_fsflagsi,           riscv_isa_rvf,                           0xfff0707f, 0x00105073 },
+	{ riscv_op_c_addi4spn,         riscv_isa_rvc,                           0x0000e003, 0x00000000 },
+	{ riscv_op_c_fld,              riscv_isa_rvc,                           0x0000e003, 0x00002000 },
+	{ riscv_op_c_lw,               riscv_isa_rvc,                           0x0000e003, 0x00004000 },
+	{ riscv_op_c_flw,              riscv_isa_rvc | riscv_isa_rv32,          0x0000e003, 0x00006000 },
+	{ riscv_op_c_fsd,              riscv_isa_rvc,                           0x0000e003, 0x0000a000 },
+	{ riscv_op_c_sw,               riscv_isa_rvc,                           0x0000e003, 0x0000c000 },
+	{ riscv_op_c_fsw,              riscv_isa_rvc | riscv_isa_rv32,          0x0000e003, 0x0000e000 },
+	{ riscv_op_c_nop,              riscv_isa_rvc,                           0x0000ffff, 0x00000001 },
+	{ riscv_op_c_addi,             riscv_isa_rvc,                           0x0000e003, 0x00000001 },
+	{ riscv_op_c_jal,              riscv_isa_rvc | riscv_isa_rv32,          0x0000e003, 0x00002001 },
+	{ riscv_op_c_li,               riscv_isa_rvc,                           0x0000e003, 0x00004001 },
+	{ riscv_op_c_lui,              riscv_isa_rvc,                           0x0000e003, 0x00006001 },
+	{ riscv_op_c_addi16sp,         riscv_isa_rvc,                           0x0000ef83, 0x00006101 },
+	{ riscv_op_c_srli,             riscv_isa_rvc,                           0x0000ec03, 0x00008001 },
+	{ riscv_op_c_srai,             riscv_isa_rvc,                           0x0000ec03, 0x00008401 },
+	{ riscv_op_c_andi,             riscv_isa_rvc,                           0x0000ec03, 0x00008801 },
+	{ riscv_op_c_sub,              riscv_isa_rvc,                           0x0000fc63, 0x00008c01 },
+	{ riscv_op_c_xor,              riscv_isa_rvc,                           0x0000fc63, 0x00008c21 },
+	{ riscv_op_c_or,               riscv_isa_rvc,                           0x0000fc63, 0x00008c41 },
+	{ riscv_op_c_and,              riscv_isa_rvc,                           0x0000fc63, 0x00008c61 },
+	{ riscv_op_c_subw,             riscv_isa_rvc,                           0x0000fc63, 0x00009c01 },
+	{ riscv_op_c_addw,             riscv_isa_rvc,                           0x0000fc63, 0x00009c21 },
+	{ riscv_op_c_j,                riscv_isa_rvc,                           0x0000e003, 0x0000a001 },
+	{ riscv_op_c_beqz,             riscv_isa_rvc,                           0x0000e003, 0x0000c001 },
+	{ riscv_op_c_bnez,             riscv_isa_rvc,                           0x0000e003, 0x0000e001 },
+	{ riscv_op_c_slli,             riscv_isa_rvc,                           0x0000e003, 0x00000002 },
+	{ riscv_op_c_fldsp,            riscv_isa_rvc,                           0x0000e003, 0x00002002 },
+	{ riscv_op_c_lwsp,             riscv_isa_rvc,                           0x0000e003, 0x00004002 },
+	{ riscv_op_c_flwsp,            riscv_isa_rvc | riscv_isa_rv32,          0x0000e003, 0x00006002 },
+	{ riscv_op_c_jr,               riscv_isa_rvc,                           0x0000f07f, 0x00008002 },
+	{ riscv_op_c_mv,               riscv_isa_rvc,                           0x0000f003, 0x00008002 },
+	{ riscv_op_c_ebreak,           riscv_isa_rvc,                           0x0000ffff, 0x00009002 },
+	{ riscv_op_c_jalr,             riscv_isa_rvc,                           0x0000f07f, 0x00009002 },
+	{ riscv_op_c_add,              riscv_isa_rvc,                           0x0000f003, 0x00009002 },
+	{ riscv_op_c_fsdsp,            riscv_isa_rvc,                           0x0000e003, 0x0000a002 },
+	{ riscv_op_c_swsp,             riscv_isa_rvc,                           0x0000e003, 0x0000c002 },
+	{ riscv_op_c_fswsp,            riscv_isa_rvc | riscv_isa_rv32,          0x0000e003, 0x0000e002 },
+	{ riscv_op_c_ld,               riscv_isa_rvc | riscv_isa_rv64,          0x0000e003, 0x00006000 },
+	{ riscv_op_c_sd,               riscv_isa_rvc | riscv_isa_rv64,          0x0000e003, 0x0000e000 },
+	{ riscv_op_c_addiw,            riscv_isa_rvc | riscv_isa_rv64,          0x0000e003, 0x00002001 },
+	{ riscv_op_c_ldsp,             riscv_isa_rvc | riscv_isa_rv64,          0x0000e003, 0x00006002 },
+	{ riscv_op_c_sdsp,             riscv_isa_rvc | riscv_isa_rv64,          0x0000e003, 0x0000e002 },
+};
+
+constexpr size_t riscv_opcode_num_rules = sizeof(riscv_opcode_rules) / sizeof(riscv_opcode_rules[0]);
+
+/*
+ * Two-level opcode table
+ *
+ * The first level is indexed by the major opcode: inst[6:2] for 32-bit
+ * instructions, or the quadrant inst[1:0] and funct3 inst[15:13] for
+ * compressed instructions. Each node selects the bits for the second level:
+ * nothing, funct3, funct7:funct3, or inst[12:2] for compressed instructions.
+ * A second level entry is either an opcode or, when the remaining fields
+ * (rs1, rs2, rd, csr) still matter, the start of a short list of links
+ * ordered by priority and ending with a link that matches any word.
+ */
+
+struct riscv_opcode_node
+{
+	riscv_hu base = 0;
+	riscv_hu mask1 = 0;
+	riscv_hu mask2 = 0;
+	riscv_bu shift1 = 0;
+	riscv_bu shift2 = 0;
+};
+
+struct riscv_opcode_link
+{
+	riscv_wu mask = 0;
+	riscv_wu match = 0;
+	riscv_hu op = 0;
+};
+
+const size_t riscv_opcode_num_majors = 56;
+const riscv_hu riscv_opcode_link_flag = 0x8000;
+
+constexpr riscv_wu riscv_opcode_major(riscv_wu inst)
+{
+	return (inst & 0b11) == 0b11 ? 24 + ((inst >> 2) & 0b11111)
+		: ((inst & 0b11) << 3) | ((inst >> 13) & 0b111);
+}
+
+constexpr riscv_wu riscv_opcode_major_bits(size_t major)
+{
+	return major >= 24 ? riscv_wu(((major - 24) << 2) | 0b11)
+		: riscv_wu((major >> 3) | ((major & 0b111) << 13));
+}
+
+constexpr riscv_wu riscv_opcode_major_mask(size_t major)
+{
+	return major >= 24 ? 0b1111111 : 0b1110000000000011;
+}
+
+constexpr size_t riscv_opcode_popcount(riscv_wu v)
+{
+	size_t n = 0;
+	for (; v; v &= v - 1) n++;
+	return n;
+}
+
+constexpr riscv_wu riscv_opcode_node_mask(const riscv_opcode_node &n)
+{
+	return (riscv_wu(n.mask1) << n.shift1) | (riscv_wu(n.mask2) << n.shift2);
+}
+
+constexpr riscv_wu riscv_opcode_node_bits(const riscv_opcode_node &n, size_t index)
+{
+	return (riscv_wu(index & n.mask1) << n.shift1) | (riscv_wu(index & n.mask2) << n.shift2);
+}
+
+constexpr size_t riscv_opcode_node_size(const riscv_opcode_node &n)
+{
+	return size_t(n.mask1 | n.mask2) + 1;
+}
+
+constexpr bool riscv_opcode_rule_compatible(const riscv_opcode_rule &r, riscv_wu bits, riscv_wu mask)
+{
+	return ((bits ^ r.match) & r.mask & mask) == 0;
+}
+
+constexpr bool riscv_opcode_rule_enabled(const riscv_opcode_rule &r, riscv_hu isa)
+{
+	return (r.isa & isa) == r.isa;
+}
+
+/* Disabled rules stay in the list unless an enabled alias replaces them, e.g. c.flw and c.ld */
+
+constexpr bool riscv_opcode_rule_listed(const riscv_opcode_rule &r, riscv_hu isa)
+{
+	if (riscv_opcode_rule_enabled(r, isa)) return true;
+	for (size_t i = 0; i < riscv_opcode_num_rules; i++) {
+		const riscv_opcode_rule &q = riscv_opcode_rules[i];
+		if (q.mask == r.mask && q.match == r.match && riscv_opcode_rule_enabled(q, isa)) return false;
+	}
+	return true;
+}
+
+/* Rules compatible with a major opcode, in priority order */
+
+struct riscv_opcode_rule_list
+{
+	size_t count;
+	riscv_hu index[riscv_opcode_num_rules];
+};
+
+constexpr riscv_opcode_rule_list riscv_opcode_major_rules(size_t major, riscv_hu isa)
+{
+	riscv_opcode_rule_list list{ 0, {} };
+	riscv_wu major_bits = riscv_opcode_major_bits(major);
+	riscv_wu major_mask = riscv_opcode_major_mask(major);
+	for (size_t i = 0; i < riscv_opcode_num_rules; i++) {
+		const riscv_opcode_rule &r = riscv_opcode_rules[i];
+		if (!riscv_opcode_rule_compatible(r, major_bits, major_mask)) continue;
+		if (!riscv_opcode_rule_listed(r, isa)) continue;
+		size_t j = list.count++;
+		for (; j > 0; j--) {
+			const riscv_opcode_rule &q = riscv_opcode_rules[list.index[j - 1]];
+			if (riscv_opcode_popcount(q.mask) >= riscv_opcode_popcount(r.mask)) break;
+			list.index[j] = list.index[j - 1];
+		}
+		list.index[j] = riscv_hu(i);
+	}
+	return list;
+}
+
+/* Second level shape, chosen from the fields any rule of the major opcode tests */
+
+constexpr riscv_opcode_node riscv_opcode_shape(const riscv_opcode_rule_list &list, size_t major)
+{
+	riscv_wu used = 0;
+	for (size_t i = 0; i < list.count; i++) {
+		used |= riscv_opcode_rules[list.index[i]].mask & ~riscv_opcode_major_mask(major);
+	}
+	if (used == 0) {
+		return riscv_opcode_node{ 0, 0, 0, 0, 0 };
+	} else if (major < 24) {
+		return riscv_opcode_node{ 0, 0b11111111111, 0, 2, 0 };
+	} else if ((used & ~(0b111 << 12)) == 0) {
+		return riscv_opcode_node{ 0, 0b111, 0, 12, 0 };
+	} else {
+		return riscv_opcode_node{ 0, 0b1111111000, 0b111, 22, 12 };
+	}
+}
+
+constexpr size_t riscv_opcode_num_entries()
+{
+	size_t n = 0;
+	for (size_t major = 0; major < riscv_opcode_num_majors; major++) {
+		n += riscv_opcode_node_size(riscv_opcode_shape(riscv_opcode_major_rules(major, 0xffff), major));
+	}
+	return n;
+}
+
+/* Upper bound on links for any ISA subset: every compatible rule plus a terminator */
+
+constexpr size_t riscv_opcode_num_links()
+{
+	size_t n = 0;
+	for (size_t major = 0; major < riscv_opcode_num_majors; major++) {
+		riscv_opcode_rule_list list = riscv_opcode_major_rules(major, 0xffff);
+		riscv_opcode_node node = riscv_opcode_shape(list, major);
+		riscv_wu mask = riscv_opcode_major_mask(major) | riscv_opcode_node_mask(node);
+		for (size_t index = 0; index < riscv_opcode_node_size(node); index++) {
+			riscv_wu bits = riscv_opcode_major_bits(major) | riscv_opcode_node_bits(node, index);
+			size_t compatible = 0;
+			bool partial = false;
+			for (size_t i = 0; i < list.count; i++) {
+				const riscv_opcode_rule &r = riscv_opcode_rules[list.index[i]];
+				if (!riscv_opcode_rule_compatible(r, bits, mask)) continue;
+				compatible++;
+				partial |= (r.mask & ~mask) != 0;
+			}
+			if (partial) n += compatible + 1;
+		}
+	}
+	return n;
+}
+
+template <riscv_hu isa>
+struct riscv_opcode_table
+{
+	riscv_opcode_node node[riscv_opcode_num_majors];
+	riscv_hu entry[riscv_opcode_num_entries()];
+	riscv_opcode_link link[riscv_opcode_num_links()];
+
+	constexpr riscv_opcode_table() : node(), entry(), link()
+	{
+		size_t num_entries = 0, num_links = 0;
+		for (size_t major = 0; major < riscv_opcode_num_majors; major++) {
+			// the shape ignores the ISA subset so every table has the same layout
+			riscv_opcode_rule_list list = riscv_opcode_major_rules(major, isa);
+			riscv_opcode_node n = riscv_opcode_shape(riscv_opcode_major_rules(major, 0xffff), major);
+			riscv_wu mask = riscv_opcode_major_mask(major) | riscv_opcode_node_mask(n);
+			n.base = riscv_hu(num_entries);
+			node[major] = n;
+			for (size_t index = 0; index < riscv_opcode_node_size(n); index++) {
+				riscv_wu bits = riscv_opcode_major_bits(major) | riscv_opcode_node_bits(n, index);
+				size_t first = num_links;
+				bool terminated = false;
+				for (size_t i = 0; i < list.count && !terminated; i++) {
+					const riscv_opcode_rule &r = riscv_opcode_rules[list.index[i]];
+					if (!riscv_opcode_rule_compatible(r, bits, mask)) continue;
+					terminated = (r.mask & ~mask) == 0;
+					link[num_links++] = riscv_opcode_link{ r.mask & ~mask, r.match & ~mask,
+						riscv_opcode_rule_enabled(r, isa) ? r.op : riscv_hu(riscv_op_unknown) };
+				}
+				if (!terminated) {
+					link[num_links++] = riscv_opcode_link{ 0, 0, riscv_op_unknown };
+				}
+				if (num_links - first == 1) {
+					// resolved by the second level alone
+					entry[num_entries++] = link[--num_links].op;
+				} else {
+					entry[num_entries++] = riscv_hu(riscv_opcode_link_flag | first);
+				}
+			}
+		}
+	}
+};
+
+template <riscv_hu isa>
+struct riscv_opcode_table_instance
+{
+	static constexpr riscv_opcode_table<isa> table{};
+};
+
+template <riscv_hu isa>
+constexpr riscv_opcode_table<isa> riscv_opcode_table_instance<isa>::table;
+
+/*
+ * Decode Instruction Opcode using the two-level table
+ *
+ * Produces the same op as riscv_decode_opcode for every word, except that
+ * riscv_op_unknown is written instead of leaving dec.op untouched.
+ */
+
+template <typename T, bool rv32 = false, bool rv64 = true, bool rvi = true, bool rvm = true, bool rva = true, bool rvs = true, bool rvf = true, bool rvd = true, bool rvc = true>
+inline void riscv_decode_opcode_table(T &dec, riscv_lu inst)
+{
+	const auto &table = riscv_opcode_table_instance<riscv_isa_flags<rv32,rv64,rvi,rvm,rva,rvs,rvf,rvd,rvc>()>::table;
+	riscv_wu w = riscv_wu(inst);
+	const riscv_opcode_node &n = table.node[riscv_opcode_major(w)];
+	riscv_hu op = table.entry[n.base + (((w >> n.shift1) & n.mask1) | ((w >> n.shift2) & n.mask2))];
+	if (op & riscv_opcode_link_flag) {
+		const riscv_opcode_link *l = table.link + (op & ~riscv_opcode_link_flag);
+		while ((w & l->mask) != l->match) l++;
+		op = l->op;
+	}
+	dec.op = op;
+}
+
+#endif
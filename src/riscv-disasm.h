@@ -10,7 +10,485 @@ typedef std::function<const char*(const char *type)> riscv_symbol_colorize_fn;
 
 const char* riscv_null_symbol_lookup(riscv_ptr, bool nearest);
 const char* riscv_null_symbol_colorize(const char *type);
-void riscv_disasm_instruction(riscv_disasm &dec, std::deque<riscv_disasm> &dec_hist,
+
+/*
+ * Disassembler policies
+ *
+ * A policy supplies symbol_name(addr, nearest) and colorize(type) to the
+ * templated riscv_disasm_instruction overloads, so the hooks can be
+ * inlined. With riscv_disasm_null_policy they compile away entirely.
+ */
+
+struct riscv_disasm_null_policy
+{
+	const char* symbol_name(riscv_ptr, bool nearest) { return nullptr; }
+	const char* colorize(const char *type) { return ""; }
+};
+
+/* Symbols from an elf_file, no color; nearest lookups render as symbol+0xoffset */
+
+struct elf_file;
+
+struct riscv_disasm_elf_policy
+{
+	elf_file &elf;
+	char symbol_tmpname[256];
+
+	riscv_disasm_elf_policy(elf_file &elf) : elf(elf) {}
+
+	const char* symbol_name(riscv_ptr addr, bool nearest);
+	const char* colorize(const char *type) { return ""; }
+};
+
+/* Adapts the std::function hooks */
+
+struct riscv_disasm_fn_policy
+{
+	riscv_symbol_name_fn &symlookup;
+	riscv_symbol_colorize_fn &colorize_fn;
+
+	const char* symbol_name(riscv_ptr addr, bool nearest) { return symlookup(addr, nearest); }
+	const char* colorize(const char *type) { return colorize_fn(type); }
+};
+
+enum rva {
+	rva_none,
+	rva_abs,
+	rva_pcrel
+};
+
+struct rvx {
+	riscv_op op1;
+	riscv_op op2;
+	rva addr;
+};
+
+static const rvx rvx_constraints[] = {
+	{ riscv_op_lui,     riscv_op_addi,     rva_abs   },
+	{ riscv_op_auipc,   riscv_op_addi,     rva_pcrel },
+	{ riscv_op_auipc,   riscv_op_jalr,     rva_pcrel },
+	{ riscv_op_auipc,   riscv_op_ld,       rva_pcrel },
+	{ riscv_op_auipc,   riscv_op_lb,       rva_pcrel },
+	{ riscv_op_auipc,   riscv_op_lh,       rva_pcrel },
+	{ riscv_op_auipc,   riscv_op_lw,       rva_pcrel },
+	{ riscv_op_auipc,   riscv_op_lbu,      rva_pcrel },
+	{ riscv_op_auipc,   riscv_op_lhu,      rva_pcrel },
+	{ riscv_op_auipc,   riscv_op_lwu,      rva_pcrel },
+	{ riscv_op_unknown, riscv_op_unknown,  rva_none  },
+};
+
+static const size_t rvx_instruction_buffer_len = 16;
+
+/* rvx_constraints grouped by op2: pairs[first[op2]] .. pairs[first[op2 + 1] - 1] */
+
+enum { rvx_num_ops = riscv_op_c_sdsp + 1 };
+
+struct rvx_pair {
+	riscv_op op1;
+	rva addr;
+};
+
+struct rvx_op2_table
+{
+	rvx_pair pairs[sizeof(rvx_constraints) / sizeof(rvx_constraints[0])];
+	riscv_hu first[rvx_num_ops + 1];
+
+	rvx_op2_table() : pairs(), first()
+	{
+		size_t n = 0;
+		for (size_t op2 = 0; op2 < rvx_num_ops; op2++) {
+			first[op2] = riscv_hu(n);
+			for (const rvx *rvxi = rvx_constraints; rvxi->addr != rva_none; rvxi++) {
+				if (rvxi->op2 == riscv_op(op2)) pairs[n++] = rvx_pair{ rvxi->op1, rvxi->addr };
+			}
+		}
+		first[rvx_num_ops] = riscv_hu(n);
+	}
+
+	static const rvx_op2_table& get()
+	{
+		static const rvx_op2_table table;
+		return table;
+	}
+};
+
+/*
+ * Instruction history
+ *
+ * Ring buffer of the last depth instructions, plus the sequence number of
+ * the newest entry for each rd value, so finding the instruction that last
+ * wrote a register is one lookup however deep the history is.
+ */
+
+struct riscv_disasm_history
+{
+	std::vector<riscv_disasm> ring;
+	size_t mask;
+	size_t depth;
+	riscv_lu seq;
+	riscv_lu base;
+	riscv_lu last_rd[64];
+
+	explicit riscv_disasm_history(size_t depth = rvx_instruction_buffer_len)
+		: mask(0), depth(depth ? depth : 1), seq(0), base(0), last_rd()
+	{
+		size_t capacity = 1;
+		while (capacity < this->depth) capacity <<= 1;
+		ring.resize(capacity);
+		mask = capacity - 1;
+	}
+
+	void clear() { base = seq; }
+
+	size_t size() const { return size_t(std::min(seq - base, riscv_lu(depth))); }
+
+	void push(const riscv_disasm &dec)
+	{
+		ring[seq & mask] = dec;
+		last_rd[dec.rd] = ++seq;
+	}
+
+	/* Newest instruction in the window whose rd is reg, or nullptr */
+	const riscv_disasm* last_writer(size_t reg) const
+	{
+		riscv_lu s = last_rd[reg];
+		if (s <= base || s + depth <= seq) return nullptr;
+		return &ring[(s - 1) & mask];
+	}
+};
+
+/*
+ * Output sinks
+ *
+ * offset is the column, which excludes colorize escapes. Numbers are
+ * formatted into a small stack buffer, right to left, without printf.
+ */
+
+static const char riscv_disasm_hex_digits[] = "0123456789abcdef";
+
+/* Fixed buffer: always NUL terminated, len counts the untruncated line */
+
+struct riscv_disasm_buf_sink
+{
+	char *buf;
+	size_t size;
+	size_t len;
+
+	void write(const char *str, size_t n)
+	{
+		if (len + 1 < size) {
+			size_t room = size - 1 - len;
+			memcpy(buf + len, str, n < room ? n : room);
+		}
+		len += n;
+	}
+	void finish() { if (size > 0) buf[len < size ? len : size - 1] = '\0'; }
+};
+
+/* Appends to a std::string */
+
+struct riscv_disasm_string_sink
+{
+	std::string &out;
+	size_t len;
+
+	void write(const char *str, size_t n) { out.append(str, n); len += n; }
+	void finish() {}
+};
+
+template <typename S>
+struct riscv_disasm_writer
+{
+	S &sink;
+	size_t offset;
+
+	void raw(const char *str) { sink.write(str, strlen(str)); }
+
+	void add(const char *str, size_t n)
+	{
+		sink.write(str, n);
+		offset += n;
+	}
+
+	void add(const char *str) { add(str, strlen(str)); }
+
+	void pad(size_t pad_to)
+	{
+		static const char *space40 = "                                        ";
+		while (offset < pad_to) {
+			size_t n = std::min(pad_to - offset, size_t(40));
+			add(space40, n);
+		}
+	}
+
+	void pad(size_t pad_to, const char *str)
+	{
+		add(str);
+		pad(pad_to);
+	}
+
+	/* %0<width>llx, or %<width>llx with fill ' ' */
+	void hex(uint64_t value, int width, char fill = '0')
+	{
+		char buf[24], *end = buf + sizeof(buf), *p = end;
+		do { *--p = riscv_disasm_hex_digits[value & 0xf]; value >>= 4; } while (value);
+		while (end - p < width) *--p = fill;
+		add(p, end - p);
+	}
+
+	/* %llu */
+	void udec(uint64_t value)
+	{
+		char buf[24], *end = buf + sizeof(buf), *p = end;
+		do { *--p = '0' + value % 10; value /= 10; } while (value);
+		add(p, end - p);
+	}
+
+	/* %lld */
+	void sdec(int64_t value)
+	{
+		if (value < 0) {
+			add("-", 1);
+			udec(uint64_t(0) - uint64_t(value));
+		} else {
+			udec(uint64_t(value));
+		}
+	}
+
+	template <typename P>
+	void addr(uint64_t addr, P &policy)
+	{
+		pad(75);
+		raw(policy.colorize("address"));
+		add("# 0x", 4);
+		hex(addr, 16);
+		raw(policy.colorize("reset"));
+		const char* symbol_name = policy.symbol_name((riscv_ptr)addr, true);
+		if (symbol_name) {
+			if (strncmp(symbol_name, "LOC_", 4) == 0) {
+				raw(" ");
+				raw(policy.colorize("location"));
+				add(symbol_name);
+				raw(policy.colorize("reset"));
+			} else {
+				raw(" ");
+				raw(policy.colorize("symbol"));
+				add("<", 1);
+				add(symbol_name);
+				add(">", 1);
+				raw(policy.colorize("reset"));
+			}
+		}
+	}
+};
+
+template <typename S, typename P>
+inline void riscv_disasm_render(S &sink, riscv_disasm &dec, riscv_disasm_history &dec_hist,
+	riscv_ptr pc, riscv_ptr next_pc, riscv_ptr pc_offset, riscv_ptr gp, P &policy)
+{
+	riscv_disasm_writer<S> line = { sink, 0 };
+	uint64_t addr = pc - pc_offset;
+	const char *fmt = riscv_instruction_format[dec.op];
+	const char *symbol_name = policy.symbol_name((riscv_ptr)addr, false);
+	const riscv_csr_metadata *csr = nullptr;
+
+	// print symbol name if present
+	if (symbol_name) {
+		if (strncmp(symbol_name, "LOC_", 4) == 0) {
+			line.raw(policy.colorize("location"));
+			line.add(symbol_name);
+			line.add(":", 1);
+			line.raw(policy.colorize("reset"));
+		} else {
+			// clear the instruction history on symbol boundaries
+			dec_hist.clear();
+			line.raw("\n");
+			line.raw(policy.colorize("address"));
+			line.add("0x", 2);
+			line.hex(addr, 16);
+			line.add(": ", 2);
+			line.raw(policy.colorize("reset"));
+			line.raw(policy.colorize("symbol"));
+			line.add("<", 1);
+			line.add(symbol_name);
+			line.add(">:", 2);
+			line.raw(policy.colorize("reset"));
+			line.raw("\n");
+			line.offset = 0;
+		}
+	}
+	line.pad(12);
+
+	// print address
+	line.raw(policy.colorize("address"));
+	line.hex(addr & 0xffffffff, 8, ' ');
+	line.add(":", 1);
+	line.raw(policy.colorize("reset"));
+	line.pad(24);
+
+	// print instruction bytes
+	switch (riscv_get_instruction_length(dec.inst)) {
+		case 2: line.hex(dec.inst, 4); break;
+		case 4: line.hex(dec.inst, 8); break;
+		case 6: line.hex(dec.inst, 12); break;
+		case 8: line.hex(dec.inst, 16); break;
+	}
+	line.pad(45);
+
+	// print opcode
+	line.raw(policy.colorize("opcode"));
+	line.pad(55, riscv_instruction_name[dec.op]);
+	line.raw(policy.colorize("reset"));
+
+	// print arguments
+	while (*fmt) {
+		switch (*fmt) {
+			case '(': line.add("(", 1); break;
+			case ',': line.add(",", 1); break;
+			case ')': line.add(")", 1); break;
+			case '0': line.add(riscv_i_registers[dec.rd]); break;
+			case '1': line.add(riscv_i_registers[dec.rs1]); break;
+			case '2': line.add(riscv_i_registers[dec.rs2]); break;
+			case '3': line.add(riscv_f_registers[dec.rd]); break;
+			case '4': line.add(riscv_f_registers[dec.rs1]); break;
+			case '5': line.add(riscv_f_registers[dec.rs2]); break;
+			case '6': line.add(riscv_f_registers[dec.rs3]); break;
+			case '7': line.udec(dec.rs1); break;
+			case 'i': line.sdec(dec.imm); break;
+ 			case 'd':
+				addr = pc - pc_offset + dec.imm;
+				line.sdec(dec.imm);
+				line.addr(addr, policy);
+				break;
+			case 'c':
+				csr = riscv_lookup_csr_metadata(dec.imm);
+				if (csr) line.add(csr->csr_name);
+				else line.udec(dec.imm);
+				break;
+			case 'r':
+				switch(dec.arg) {
+					case riscv_rm_rne: line.add("rne", 3); break;
+					case riscv_rm_rtz: line.add("rtz", 3); break;
+					case riscv_rm_rdn: line.add("rdn", 3); break;
+					case riscv_rm_rup: line.add("rup", 3); break;
+					case riscv_rm_rmm: line.add("rmm", 3); break;
+					default:           line.add("unk", 3); break;
+				}
+				break;
+			case 'a':
+				switch(dec.arg) {
+					case riscv_aqrl_relaxed: line.add("relaxed"); break;
+					case riscv_aqrl_acquire: line.add("acquire"); break;
+					case riscv_aqrl_release: line.add("release"); break;
+					case riscv_aqrl_acq_rel: line.add("acq_rel"); break;
+				}
+ 				break;
+			default:
+				break;
+		}
+		fmt++;
+	}
+
+	// decode address using instruction pair constraints
+	addr = 0;
+	// only the newest writer of rs1 can pair: any other primitive in between breaks the pair
+	const rvx_op2_table &rvxt = rvx_op2_table::get();
+	if (dec.op < rvx_num_ops && rvxt.first[dec.op] != rvxt.first[dec.op + 1]) {
+		const riscv_disasm *li = dec_hist.last_writer(dec.rs1);
+		for (size_t i = rvxt.first[dec.op]; li && i < rvxt.first[dec.op + 1]; i++) {
+			if (rvxt.pairs[i].op1 != li->op) continue;
+			switch (rvxt.pairs[i].addr) {
+				case rva_abs:
+					addr = li->imm + dec.imm;
+					break;
+				case rva_pcrel:
+					addr = li->pc - pc_offset + li->imm + dec.imm;
+					break;
+				case rva_none:
+				default:
+					continue;
+			}
+			break;
+		}
+	}
+
+	// decode address for loads and stores from the global pointer
+	if (addr == 0 && gp && dec.rs1 == riscv_ireg_gp)
+	{
+		switch (dec.op) {
+			case riscv_op_addi:
+			case riscv_op_lb:
+			case riscv_op_lh:
+			case riscv_op_lw:
+			case riscv_op_ld:
+			case riscv_op_lbu:
+			case riscv_op_lhu:
+			case riscv_op_lwu:
+			case riscv_op_flw:
+			case riscv_op_fld:
+			case riscv_op_sb:
+			case riscv_op_sh:
+			case riscv_op_sw:
+			case riscv_op_sd:
+			case riscv_op_fsw:
+			case riscv_op_fsd:
+				addr = int64_t(gp + dec.imm);
+			default:
+				break;
+		}
+	}
+
+	// print address if present
+	if (addr != 0) {
+		line.addr(addr, policy);
+	}
+
+	// save instruction in deque
+	dec_hist.push(dec);
+
+	line.raw("\n");
+	sink.finish();
+}
+
+/*
+ * Disassemble one instruction as a line ending in '\n'.
+ *
+ * The buffer form writes at most buf_size - 1 characters plus a NUL and
+ * returns the full line length, like snprintf. The string form appends
+ * and returns the number of characters appended. The plain form writes
+ * the line to stdout. Each takes either a policy object or the
+ * std::function hooks.
+ */
+
+template <typename P>
+inline auto riscv_disasm_instruction(char *buf, size_t buf_size, riscv_disasm &dec, riscv_disasm_history &dec_hist,
+	riscv_ptr pc, riscv_ptr next_pc, riscv_ptr pc_offset, riscv_ptr gp, P &&policy)
+	-> decltype(policy.colorize(""), size_t())
+{
+	riscv_disasm_buf_sink sink = { buf, buf_size, 0 };
+	riscv_disasm_render(sink, dec, dec_hist, pc, next_pc, pc_offset, gp, policy);
+	return sink.len;
+}
+
+template <typename P>
+inline auto riscv_disasm_instruction(std::string &buf, riscv_disasm &dec, riscv_disasm_history &dec_hist,
+	riscv_ptr pc, riscv_ptr next_pc, riscv_ptr pc_offset, riscv_ptr gp, P &&policy)
+	-> decltype(policy.colorize(""), size_t())
+{
+	riscv_disasm_string_sink sink = { buf, 0 };
+	riscv_disasm_render(sink, dec, dec_hist, pc, next_pc, pc_offset, gp, policy);
+	return sink.len;
+}
+
+size_t riscv_disasm_instruction(char *buf, size_t buf_size, riscv_disasm &dec, riscv_disasm_history &dec_hist,
+	riscv_ptr pc, riscv_ptr next_pc, riscv_ptr pc_offset, riscv_ptr gp,
+	riscv_symbol_name_fn symlookup = riscv_null_symbol_lookup,
+	riscv_symbol_colorize_fn colorize = riscv_null_symbol_colorize);
+size_t riscv_disasm_instruction(std::string &buf, riscv_disasm &dec, riscv_disasm_history &dec_hist,
+	riscv_ptr pc, riscv_ptr next_pc, riscv_ptr pc_offset, riscv_ptr gp,
+	riscv_symbol_name_fn symlookup = riscv_null_symbol_lookup,
+	riscv_symbol_colorize_fn colorize = riscv_null_symbol_colorize);
+void riscv_disasm_instruction(riscv_disasm &dec, riscv_disasm_history &dec_hist,
 	riscv_ptr pc, riscv_ptr next_pc, riscv_ptr pc_offset, riscv_ptr gp,
 	riscv_symbol_name_fn symlookup = riscv_null_symbol_lookup,
 	riscv_symbol_colorize_fn colorize = riscv_null_symbol_colorize);
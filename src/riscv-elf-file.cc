@@ -6,26 +6,49 @@
 #include <cstdint>
 #include <cstring>
 #include <cerrno>
+#include <climits>
 #include <string>
 #include <vector>
 #include <map>
 #include <functional>
+#include <algorithm>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
+#include "riscv-endian.h"
 #include "riscv-elf.h"
 #include "riscv-elf-file.h"
 #include "riscv-elf-format.h"
 #include "riscv-util.h"
 
 
-elf_file::elf_file() {}
+#if BYTE_ORDER == LITTLE_ENDIAN
+static const int elf_host_data = ELFDATA2LSB;
+#else
+static const int elf_host_data = ELFDATA2MSB;
+#endif
 
-elf_file::elf_file(std::string filename)
+elf_file::elf_file() : map(nullptr), map_size(0), map_fd(-1), lazy_file(nullptr)
+{
+	clear();
+}
+
+elf_file::elf_file(std::string filename) : map(nullptr), map_size(0), map_fd(-1), lazy_file(nullptr)
 {
 	load(filename);
 }
 
+elf_file::~elf_file()
+{
+	if (map) munmap(map, map_size);
+	if (map_fd >= 0) close(map_fd);
+	if (lazy_file) fclose(lazy_file);
+}
+
 void elf_file::clear()
 {
 	filename = "";
@@ -37,15 +60,32 @@ void elf_file::clear()
 	phdrs.resize(0);
 	shdrs.resize(0);
 	symbols.resize(0);
-	addr_symbol_map.clear();
-	name_symbol_map.clear();
+	addr_symbol_index.clear();
+	name_symbol_index.clear();
 	shstrtab = nullptr;
 	symtab = nullptr;
 	strtab = nullptr;
 	sections.resize(0);
+	if (map) munmap(map, map_size);
+	map = nullptr;
+	map_size = 0;
+	if (map_fd >= 0) close(map_fd);
+	map_fd = -1;
+	if (lazy_file) fclose(lazy_file);
+	lazy_file = nullptr;
 }
 
 void elf_file::load(std::string filename)
+{
+	load_file(filename, elf_load_eager);
+}
+
+void elf_file::load_lazy(std::string filename)
+{
+	load_file(filename, elf_load_lazy);
+}
+
+void elf_file::load_file(std::string filename, elf_load_mode mode)
 {
 	FILE *file;
 	struct stat stat_buf;
@@ -169,23 +209,18 @@ void elf_file::load(std::string filename)
 	}
 
 	// Find strtab and symtab
-	shstrtab = symtab = strtab = nullptr;
-	for (size_t i = 0; i < shdrs.size(); i++) {
-		if (shstrtab == nullptr && shdrs[i].sh_type == SHT_STRTAB && ehdr.e_shstrndx == i) {
-			shstrtab = &shdrs[i];
-		} else if (symtab == nullptr && shdrs[i].sh_type == SHT_SYMTAB) {
-			symtab = &shdrs[i];
-			if (shdrs[i].sh_link > 0) {
-				strtab = &shdrs[shdrs[i].sh_link];
-			}
-		}
-	}
+	find_symbol_tables();
 
-	// read section data into buffers
+	// read section data into buffers (none for elf_load_lazy, which keeps
+	// the file open for materialize)
 	sections.resize(shdrs.size());
 	for (size_t i = 0; i < shdrs.size(); i++) {
 		sections[i].offset = shdrs[i].sh_offset;
 		sections[i].size = shdrs[i].sh_size;
+		sections[i].view = nullptr;
+		sections[i].loaded = mode != elf_load_lazy || shdrs[i].sh_type == SHT_NOBITS;
+		sections[i].dirty = false;
+		if (!sections[i].loaded) continue;
 		if (shdrs[i].sh_type == SHT_NOBITS) continue;
 		fseek(file, shdrs[i].sh_offset, SEEK_SET);
 		sections[i].buf.resize(shdrs[i].sh_size);
@@ -194,7 +229,11 @@ void elf_file::load(std::string filename)
 			panic("error fread: %s", filename.c_str());
 		}
 	}
-	fclose(file);
+	if (mode == elf_load_lazy) {
+		lazy_file = file;
+	} else {
+		fclose(file);
+	}
 	buf.resize(0);
 
 	// byteswap symbol table
@@ -204,110 +243,396 @@ void elf_file::load(std::string filename)
 	copy_from_symbol_table_sections();
 }
 
-void elf_file::save(std::string filename)
+void elf_file::load_mmap(std::string filename)
 {
-	FILE *file;
-	std::vector<uint8_t> buf;
+	std::string error;
+	if (!load_mmap(filename, error)) {
+		panic("%s", error.c_str());
+	}
+}
 
-	// open file
+bool elf_file::load_mmap(std::string filename, std::string &error)
+{
+	int fd;
+	struct stat stat_buf;
+
+	// a malformed file leaves the elf_file cleared and error set
+	auto fail = [&](std::string message) {
+		error = message;
+		clear();
+		return false;
+	};
+
+	// clear current data
+	clear();
+
+	// open and map file; private writable pages are only copied if written,
+	// and the descriptor stays open so save() can copy unchanged sections from it
 	this->filename = filename;
-	file = fopen(filename.c_str(), "w");
-	if (!file) {
-		panic("error fopen: %s: %s", filename.c_str(), strerror(errno));
+	fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return fail(format_string("error open: %s: %s", filename.c_str(), strerror(errno)));
+	}
+	if (fstat(fd, &stat_buf) < 0) {
+		std::string message = format_string("error fstat: %s: %s", filename.c_str(), strerror(errno));
+		close(fd);
+		return fail(message);
+	}
+	if (stat_buf.st_size < EI_NIDENT) {
+		close(fd);
+		return fail(format_string("error invalid ELF file: %s", filename.c_str()));
+	}
+	filesize = stat_buf.st_size;
+	void *addr = mmap(nullptr, filesize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+		std::string message = format_string("error mmap: %s: %s", filename.c_str(), strerror(errno));
+		close(fd);
+		return fail(message);
 	}
+	map = (uint8_t*)addr;
+	map_size = filesize;
+	map_fd = fd;
 
-	// update symbol table section based on changes to symbols
-	copy_to_symbol_table_sections();
+	// check file magic
+	if (!elf_check_magic(map)) {
+		return fail(format_string("error invalid ELF magic: %s", filename.c_str()));
+	}
+	ei_class = map[EI_CLASS];
+	ei_data = map[EI_DATA];
+	bool native = ei_data == elf_host_data;
 
-	// recompute section offsets based on changes to headers and sections
-	recalculate_section_offsets();
+	// byteswap and normalize a copy of the file header
+	switch (ei_class) {
+		case ELFCLASS32: {
+			Elf32_Ehdr ehdr32;
+			if (map_size < sizeof(ehdr32)) {
+				return fail(format_string("error invalid ELF file: %s", filename.c_str()));
+			}
+			memcpy(&ehdr32, map, sizeof(ehdr32));
+			elf_bswap_ehdr32(&ehdr32, ei_data, ELFENDIAN_HOST);
+			elf_ehdr32_to_ehdr64(&ehdr, &ehdr32);
+			break;
+		}
+		case ELFCLASS64:
+			if (map_size < sizeof(ehdr)) {
+				return fail(format_string("error invalid ELF file: %s", filename.c_str()));
+			}
+			memcpy(&ehdr, map, sizeof(ehdr));
+			if (!native) elf_bswap_ehdr64(&ehdr, ei_data, ELFENDIAN_HOST);
+			break;
+		default:
+			return fail(format_string("error invalid ELF class: %s", filename.c_str()));
+	}
+
+	// check header version
+	if (ehdr.e_version != EV_CURRENT) {
+		return fail(format_string("error invalid ELF version: %s", filename.c_str()));
+	}
 
-	// byteswap, de-normalize and write file header
+	// check the header tables lie within the mapping
+	size_t phdr_size = ei_class == ELFCLASS32 ? sizeof(Elf32_Phdr) : sizeof(Elf64_Phdr);
+	size_t shdr_size = ei_class == ELFCLASS32 ? sizeof(Elf32_Shdr) : sizeof(Elf64_Shdr);
+	if ((ehdr.e_phnum && (ehdr.e_phoff > map_size || ehdr.e_phnum * phdr_size > map_size - ehdr.e_phoff)) ||
+		(ehdr.e_shnum && (ehdr.e_shoff > map_size || ehdr.e_shnum * shdr_size > map_size - ehdr.e_shoff))) {
+		return fail(format_string("error ELF headers extend past end of file: %s", filename.c_str()));
+	}
+
+	// program and section headers are copied in one go when already 64-bit host order
+	phdrs.resize(ehdr.e_phnum);
+	shdrs.resize(ehdr.e_shnum);
 	switch (ei_class) {
 		case ELFCLASS32:
-			buf.resize(sizeof(Elf32_Ehdr));
-			elf_ehdr64_to_ehdr32((Elf32_Ehdr*)buf.data(), &ehdr);
-			elf_bswap_ehdr32((Elf32_Ehdr*)buf.data(), ei_data, ELFENDIAN_TARGET);
+			for (size_t i = 0; i < phdrs.size(); i++) {
+				Elf32_Phdr phdr32;
+				memcpy(&phdr32, map + ehdr.e_phoff + i * sizeof(Elf32_Phdr), sizeof(phdr32));
+				elf_bswap_phdr32(&phdr32, ei_data, ELFENDIAN_HOST);
+				elf_phdr32_to_phdr64(&phdrs[i], &phdr32);
+			}
+			for (size_t i = 0; i < shdrs.size(); i++) {
+				Elf32_Shdr shdr32;
+				memcpy(&shdr32, map + ehdr.e_shoff + i * sizeof(Elf32_Shdr), sizeof(shdr32));
+				elf_bswap_shdr32(&shdr32, ei_data, ELFENDIAN_HOST);
+				elf_shdr32_to_shdr64(&shdrs[i], &shdr32);
+			}
 			break;
 		case ELFCLASS64:
-			buf.resize(sizeof(Elf64_Ehdr));
-			memcpy((Elf64_Ehdr*)buf.data(), &ehdr, sizeof(Elf64_Ehdr));
-			elf_bswap_ehdr64((Elf64_Ehdr*)buf.data(), ei_data, ELFENDIAN_TARGET);
+			if (!phdrs.empty()) memcpy(phdrs.data(), map + ehdr.e_phoff, phdrs.size() * sizeof(Elf64_Phdr));
+			if (!shdrs.empty()) memcpy(shdrs.data(), map + ehdr.e_shoff, shdrs.size() * sizeof(Elf64_Shdr));
+			if (!native) {
+				for (auto &phdr : phdrs) elf_bswap_phdr64(&phdr, ei_data, ELFENDIAN_HOST);
+				for (auto &shdr : shdrs) elf_bswap_shdr64(&shdr, ei_data, ELFENDIAN_HOST);
+			}
 			break;
-		default:
-			fclose(file);
-			panic("error invalid ELF class: %s", filename.c_str());
 	}
-	if (fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
-		fclose(file);
-		panic("error fwrite: %s", filename.c_str());
+
+	// check every section lies within the mapping before anything looks up a
+	// section name, which needs the views; report a bad one by index
+	for (size_t i = 0; i < shdrs.size(); i++) {
+		if (shdrs[i].sh_type == SHT_NOBITS) continue;
+		if (shdrs[i].sh_offset > map_size || shdrs[i].sh_size > map_size - shdrs[i].sh_offset) {
+			return fail(format_string("error section %zu extends past end of file: %s", i, filename.c_str()));
+		}
+	}
+
+	// Find strtab and symtab
+	find_symbol_tables();
+
+	// the symbol table is read sizeof(Elf*_Sym) per sh_entsize, and every
+	// symbol name must be terminated inside the string table
+	size_t sym_size = ei_class == ELFCLASS32 ? sizeof(Elf32_Sym) : sizeof(Elf64_Sym);
+	if (symtab && (symtab->sh_entsize < sym_size || (symtab->sh_link > 0 && !strtab))) {
+		return fail(format_string("error invalid symbol table: %s", filename.c_str()));
+	}
+	if (strtab && (strtab->sh_type == SHT_NOBITS || (strtab->sh_size > 0 && map[strtab->sh_offset + strtab->sh_size - 1] != 0))) {
+		return fail(format_string("error invalid string table: %s", filename.c_str()));
+	}
+
+	// point sections into the mapping
+	sections.resize(shdrs.size());
+	for (size_t i = 0; i < shdrs.size(); i++) {
+		sections[i].offset = shdrs[i].sh_offset;
+		sections[i].size = shdrs[i].sh_size;
+		sections[i].view = shdrs[i].sh_type == SHT_NOBITS ? nullptr : map + shdrs[i].sh_offset;
+		sections[i].loaded = true;
+		sections[i].dirty = false;
+	}
+
+	// byteswap symbol table; this copies only the symtab pages, and only for foreign byte order
+	if (!native) byteswap_symbol_table(ELFENDIAN_HOST);
+
+	// st_name is the first field of both symbol layouts
+	if (strtab) {
+		size_t num_symbols = symtab->sh_size / symtab->sh_entsize;
+		for (size_t i = 0; i < num_symbols; i++) {
+			uint32_t st_name;
+			memcpy(&st_name, map + symtab->sh_offset + i * sym_size, sizeof(st_name));
+			if (st_name >= strtab->sh_size) {
+				return fail(format_string("error symbol %zu name outside string table: %s", i, filename.c_str()));
+			}
+		}
+	}
+
+	// update symbol maps
+	copy_from_symbol_table_sections();
+	return true;
+}
+
+/*
+ * One contiguous run of the output file, either from memory or copied
+ * from src_fd at src_offset
+ */
+
+struct elf_extent
+{
+	size_t offset;
+	size_t size;
+	const uint8_t *data;
+	int src_fd;
+	size_t src_offset;
+};
+
+static bool elf_write_iov(int fd, size_t offset, struct iovec *iov, size_t iovcnt)
+{
+	if (lseek(fd, offset, SEEK_SET) < 0) return false;
+	while (iovcnt > 0) {
+		ssize_t n = writev(fd, iov, int(std::min(iovcnt, size_t(IOV_MAX))));
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		// step past fully written buffers, then trim a partly written one
+		while (iovcnt > 0 && size_t(n) >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t*)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
 	}
+	return true;
+}
 
-	// byteswap, de-normalize and write program and section headers
+static bool elf_copy_range(int src_fd, size_t src_offset, int dst_fd, size_t dst_offset, size_t size)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+	// in-kernel copy, which may share extents on filesystems that support it
+	loff_t src_off = src_offset, dst_off = dst_offset;
+	while (size > 0) {
+		ssize_t n = copy_file_range(src_fd, &src_off, dst_fd, &dst_off, size, 0);
+		if (n <= 0) break;
+		size -= n;
+	}
+	if (size == 0) return true;
+	src_offset = src_off;
+	dst_offset = dst_off;
+#endif
+	std::vector<uint8_t> buf(std::min(size, size_t(1) << 20));
+	while (size > 0) {
+		ssize_t n = pread(src_fd, buf.data(), std::min(size, buf.size()), src_offset);
+		if (n <= 0) return false;
+		if (pwrite(dst_fd, buf.data(), n, dst_offset) != n) return false;
+		src_offset += n;
+		dst_offset += n;
+		size -= n;
+	}
+	return true;
+}
+
+void elf_file::save(std::string filename)
+{
+	std::vector<uint8_t> ehdr_buf, phdr_buf, shdr_buf;
+
+	// truncating the file behind a mapped load would fault on the section views
+	if (map && filename == this->filename) {
+		panic("error save over mapped file: %s", filename.c_str());
+	}
+
+	// read the untouched sections of a lazy load first if it is saved over itself
+	bool lazy_copy = lazy_file && filename != this->filename;
+	if (!lazy_copy) {
+		for (size_t i = 0; i < sections.size(); i++) {
+			materialize(i);
+		}
+	}
+
+	// update symbol table section based on changes to symbols
+	copy_to_symbol_table_sections();
+
+	// recompute section offsets based on changes to headers and sections
+	recalculate_section_offsets();
+
+	// byteswap and de-normalize file, program and section headers into contiguous tables
 	switch (ei_class) {
 		case ELFCLASS32:
-			buf.resize(sizeof(Elf32_Phdr));
+			ehdr_buf.resize(sizeof(Elf32_Ehdr));
+			elf_ehdr64_to_ehdr32((Elf32_Ehdr*)ehdr_buf.data(), &ehdr);
+			elf_bswap_ehdr32((Elf32_Ehdr*)ehdr_buf.data(), ei_data, ELFENDIAN_TARGET);
+			phdr_buf.resize(phdrs.size() * sizeof(Elf32_Phdr));
 			for (size_t i = 0; i < phdrs.size(); i++) {
-				elf_phdr64_to_phdr32((Elf32_Phdr*)buf.data(), &phdrs[i]);
-				elf_bswap_phdr32((Elf32_Phdr*)buf.data(), ei_data, ELFENDIAN_TARGET);
-				fseek(file, ehdr.e_phoff + i * sizeof(Elf32_Phdr), SEEK_SET);
-				if (fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
-					fclose(file);
-					panic("error fwrite: %s", filename.c_str());
-				}
+				Elf32_Phdr *phdr32 = (Elf32_Phdr*)phdr_buf.data() + i;
+				elf_phdr64_to_phdr32(phdr32, &phdrs[i]);
+				elf_bswap_phdr32(phdr32, ei_data, ELFENDIAN_TARGET);
 			}
-			buf.resize(sizeof(Elf32_Shdr));
+			shdr_buf.resize(shdrs.size() * sizeof(Elf32_Shdr));
 			for (size_t i = 0; i < shdrs.size(); i++) {
-				elf_shdr64_to_shdr32((Elf32_Shdr*)buf.data(), &shdrs[i]);
-				elf_bswap_shdr32((Elf32_Shdr*)buf.data(), ei_data, ELFENDIAN_TARGET);
-				fseek(file, ehdr.e_shoff + i * sizeof(Elf32_Shdr), SEEK_SET);
-				if (fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
-					fclose(file);
-					panic("error fwrite: %s", filename.c_str());
-				}
+				Elf32_Shdr *shdr32 = (Elf32_Shdr*)shdr_buf.data() + i;
+				elf_shdr64_to_shdr32(shdr32, &shdrs[i]);
+				elf_bswap_shdr32(shdr32, ei_data, ELFENDIAN_TARGET);
 			}
 			break;
 		case ELFCLASS64:
-			buf.resize(sizeof(Elf64_Phdr));
+			ehdr_buf.resize(sizeof(Elf64_Ehdr));
+			memcpy(ehdr_buf.data(), &ehdr, sizeof(Elf64_Ehdr));
+			elf_bswap_ehdr64((Elf64_Ehdr*)ehdr_buf.data(), ei_data, ELFENDIAN_TARGET);
+			phdr_buf.resize(phdrs.size() * sizeof(Elf64_Phdr));
+			memcpy(phdr_buf.data(), phdrs.data(), phdr_buf.size());
 			for (size_t i = 0; i < phdrs.size(); i++) {
-				memcpy((Elf64_Phdr*)buf.data(), &phdrs[i], sizeof(Elf64_Phdr));
-				elf_bswap_phdr64((Elf64_Phdr*)buf.data(), ei_data, ELFENDIAN_TARGET);
-				fseek(file, ehdr.e_phoff + i * sizeof(Elf64_Phdr), SEEK_SET);
-				if (fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
-					fclose(file);
-					panic("error fwrite: %s", filename.c_str());
-				}
+				elf_bswap_phdr64((Elf64_Phdr*)phdr_buf.data() + i, ei_data, ELFENDIAN_TARGET);
 			}
-			buf.resize(sizeof(Elf64_Shdr));
+			shdr_buf.resize(shdrs.size() * sizeof(Elf64_Shdr));
+			memcpy(shdr_buf.data(), shdrs.data(), shdr_buf.size());
 			for (size_t i = 0; i < shdrs.size(); i++) {
-				memcpy((Elf64_Shdr*)buf.data(), &shdrs[i], sizeof(Elf64_Shdr));
-				elf_bswap_shdr64((Elf64_Shdr*)buf.data(), ei_data, ELFENDIAN_TARGET);
-				fseek(file, ehdr.e_shoff + i * sizeof(Elf64_Shdr), SEEK_SET);
-				if (fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
-					fclose(file);
-					panic("error fwrite: %s", filename.c_str());
-				}
+				elf_bswap_shdr64((Elf64_Shdr*)shdr_buf.data() + i, ei_data, ELFENDIAN_TARGET);
 			}
 			break;
+		default:
+			panic("error invalid ELF class: %s", filename.c_str());
+	}
+
+	// plan the output as extents in file order
+	std::vector<elf_extent> extents;
+	extents.push_back(elf_extent{ 0, ehdr_buf.size(), ehdr_buf.data(), -1, 0 });
+	if (phdr_buf.size()) extents.push_back(elf_extent{ ehdr.e_phoff, phdr_buf.size(), phdr_buf.data(), -1, 0 });
+	if (shdr_buf.size()) extents.push_back(elf_extent{ ehdr.e_shoff, shdr_buf.size(), shdr_buf.data(), -1, 0 });
+	for (size_t i = 0; i < sections.size(); i++) {
+		elf_section &sec = sections[i];
+		if (shdrs[i].sh_type == SHT_NOBITS || shdrs[i].sh_size == 0) continue;
+		if (&shdrs[i] != symtab && !sec.dirty && sec.view && map_fd >= 0) {
+			extents.push_back(elf_extent{ shdrs[i].sh_offset, shdrs[i].sh_size, nullptr, map_fd, size_t(sec.view - map) });
+		} else if (!sec.loaded && lazy_copy) {
+			extents.push_back(elf_extent{ shdrs[i].sh_offset, shdrs[i].sh_size, nullptr, fileno(lazy_file), sec.offset });
+		} else if (sec.view ? sec.size < shdrs[i].sh_size : sec.buf.size() < shdrs[i].sh_size) {
+			panic("error section %s not loaded: %s", shdr_name(i), filename.c_str());
+		} else {
+			extents.push_back(elf_extent{ shdrs[i].sh_offset, shdrs[i].sh_size, sec.data(), -1, 0 });
+		}
+	}
+	std::sort(extents.begin(), extents.end(), [](const elf_extent &a, const elf_extent &b) {
+		return a.offset < b.offset;
+	});
+
+	// open file
+	this->filename = filename;
+	int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		panic("error open: %s: %s", filename.c_str(), strerror(errno));
 	}
 
 	// byteswap symbol table
 	byteswap_symbol_table(ELFENDIAN_TARGET);
 
-	// write section buffers to file
-	for (size_t i = 0; i < sections.size(); i++) {
-		if (shdrs[i].sh_type == SHT_NOBITS) continue;
-		fseek(file, shdrs[i].sh_offset, SEEK_SET);
-		if (fwrite(sections[i].buf.data(), 1, shdrs[i].sh_size, file) != shdrs[i].sh_size) {
-			fclose(file);
-			panic("error fwrite: %s", filename.c_str());
+	// gather adjacent in-memory extents into one write; gaps are left as holes
+	std::vector<struct iovec> iov;
+	size_t iov_offset = 0, iov_end = 0, file_end = 0;
+	bool ok = true;
+	for (size_t i = 0; ok && i <= extents.size(); i++) {
+		bool flush = i == extents.size() || extents[i].src_fd >= 0 || extents[i].offset != iov_end;
+		if (flush && !iov.empty()) {
+			ok = elf_write_iov(fd, iov_offset, iov.data(), iov.size());
+			iov.clear();
 		}
+		if (!ok || i == extents.size()) break;
+		elf_extent &ext = extents[i];
+		file_end = std::max(file_end, ext.offset + ext.size);
+		if (ext.src_fd >= 0) {
+			ok = elf_copy_range(ext.src_fd, ext.src_offset, fd, ext.offset, ext.size);
+			continue;
+		}
+		if (iov.empty()) iov_offset = iov_end = ext.offset;
+		iov.push_back(iovec{ (void*)ext.data, ext.size });
+		iov_end += ext.size;
 	}
+	if (ok && ftruncate(fd, file_end) < 0) ok = false;
 
 	// byteswap symbol table
 	byteswap_symbol_table(ELFENDIAN_HOST);
 
-	fclose(file);
+	if (close(fd) < 0) ok = false;
+	if (!ok) {
+		panic("error write: %s: %s", filename.c_str(), strerror(errno));
+	}
+}
+
+void elf_file::materialize(size_t i)
+{
+	elf_section &sec = sections[i];
+	if (sec.loaded) return;
+	sec.buf.resize(sec.size);
+	// pread leaves the shared file position alone
+	for (size_t done = 0; done < sec.size; ) {
+		ssize_t n = pread(fileno(lazy_file), sec.buf.data() + done, sec.size - done, sec.offset + done);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) panic("error pread: %s: %s", filename.c_str(), n < 0 ? strerror(errno) : "unexpected end of file");
+		done += n;
+	}
+	sec.loaded = true;
+}
+
+void elf_file::find_symbol_tables()
+{
+	shstrtab = symtab = strtab = nullptr;
+	for (size_t i = 0; i < shdrs.size(); i++) {
+		if (shstrtab == nullptr && shdrs[i].sh_type == SHT_STRTAB && ehdr.e_shstrndx == i) {
+			shstrtab = &shdrs[i];
+		} else if (symtab == nullptr && shdrs[i].sh_type == SHT_SYMTAB) {
+			symtab = &shdrs[i];
+			if (shdrs[i].sh_link > 0 && shdrs[i].sh_link < shdrs.size()) {
+				strtab = &shdrs[shdrs[i].sh_link];
+			}
+		}
+	}
 }
 
 void elf_file::byteswap_symbol_table(ELFENDIAN endian)
@@ -334,8 +659,8 @@ void elf_file::byteswap_symbol_table(ELFENDIAN endian)
 void elf_file::copy_from_symbol_table_sections()
 {
 	symbols.clear();
-	addr_symbol_map.clear();
-	name_symbol_map.clear();
+	addr_symbol_index.clear();
+	name_symbol_index.clear();
 
 	if (!symtab) return;
 
@@ -359,15 +684,19 @@ void elf_file::copy_from_symbol_table_sections()
 
 	if (!strtab) return;
 
+	std::vector<size_t> addr_symbols;
+	std::vector<std::pair<const char*,size_t>> name_symbols;
 	for (size_t i = 0; i < symbols.size(); i++) {
 		auto &sym = symbols[i];
 		if (sym.st_shndx != SHN_UNDEF && sym.st_info != STT_FILE && sym.st_value != 0) {
 			const char* name = (const char*)offset(strtab->sh_offset + sym.st_name);
 			if (!strlen(name)) continue;
-			name_symbol_map[name] = i;
-			addr_symbol_map[sym.st_value] = i;
+			name_symbols.push_back(std::make_pair(name, i));
+			addr_symbols.push_back(i);
 		}
 	}
+	addr_symbol_index.build(symbols, addr_symbols);
+	name_symbol_index.build(name_symbols);
 }
 
 void elf_file::copy_to_symbol_table_sections()
@@ -377,14 +706,265 @@ void elf_file::copy_to_symbol_table_sections()
 
 void elf_file::recalculate_section_offsets()
 {
-	// TODO
+	struct piece { size_t offset; size_t size; size_t align; Elf64_Shdr *shdr; };
+
+	// the file header, program headers and sections keep their offsets unless
+	// they overlap something earlier in the file, in which case they move past the end
+	size_t phdr_size = ei_class == ELFCLASS32 ? sizeof(Elf32_Phdr) : sizeof(Elf64_Phdr);
+	size_t shdr_size = ei_class == ELFCLASS32 ? sizeof(Elf32_Shdr) : sizeof(Elf64_Shdr);
+	size_t ehdr_size = ei_class == ELFCLASS32 ? sizeof(Elf32_Ehdr) : sizeof(Elf64_Ehdr);
+	std::vector<piece> pieces;
+	pieces.push_back(piece{ 0, ehdr_size, 1, nullptr });
+	if (phdrs.size()) pieces.push_back(piece{ ehdr.e_phoff, phdrs.size() * phdr_size, 1, nullptr });
+	for (auto &shdr : shdrs) {
+		if (shdr.sh_type == SHT_NOBITS || shdr.sh_size == 0) continue;
+		pieces.push_back(piece{ shdr.sh_offset, shdr.sh_size, std::max(shdr.sh_addralign, Elf64_Xword(1)), &shdr });
+	}
+	std::stable_sort(pieces.begin(), pieces.end(), [](const piece &a, const piece &b) {
+		return a.offset < b.offset;
+	});
+
+	size_t end = 0;
+	std::vector<piece*> moved;
+	for (auto &p : pieces) {
+		if (p.offset < end && p.shdr) {
+			moved.push_back(&p);
+		} else {
+			end = std::max(end, p.offset + p.size);
+		}
+	}
+
+	// the bytes of a PT_LOAD segment are loaded as one image, so a section
+	// inside one may neither move nor grow past the end of the segment
+	for (size_t i = 0; i < shdrs.size(); i++) {
+		if (shdrs[i].sh_type == SHT_NOBITS || shdrs[i].sh_size == 0) continue;
+		for (auto &phdr : phdrs) {
+			if (phdr.p_type != PT_LOAD || sections[i].offset < phdr.p_offset ||
+				sections[i].offset >= phdr.p_offset + phdr.p_filesz) continue;
+			bool was_inside = sections[i].offset + sections[i].size <= phdr.p_offset + phdr.p_filesz;
+			if (was_inside && shdrs[i].sh_offset + shdrs[i].sh_size > phdr.p_offset + phdr.p_filesz) {
+				panic("error section %s grows past its PT_LOAD segment: %s", shdr_name(i), filename.c_str());
+			}
+		}
+	}
+	for (auto p : moved) {
+		size_t i = p->shdr - shdrs.data();
+		for (auto &phdr : phdrs) {
+			if (phdr.p_type == PT_LOAD && sections[i].offset < phdr.p_offset + phdr.p_filesz &&
+				phdr.p_offset < sections[i].offset + sections[i].size) {
+				panic("error section %s must move but lies in a PT_LOAD segment: %s", shdr_name(i), filename.c_str());
+			}
+		}
+	}
+	for (auto p : moved) {
+		size_t i = p->shdr - shdrs.data();
+		materialize(i);
+		p->offset = (end + p->align - 1) / p->align * p->align;
+		p->shdr->sh_offset = p->offset;
+		sections[i].offset = p->offset;
+		end = p->offset + p->size;
+	}
+
+	// the section header table goes last if anything now overlaps it
+	size_t shdrs_end = ehdr.e_shoff + shdrs.size() * shdr_size;
+	bool shdrs_overlap = false;
+	for (auto &p : pieces) {
+		if (p.offset < shdrs_end && ehdr.e_shoff < p.offset + p.size) shdrs_overlap = true;
+	}
+	if (shdrs.size() && shdrs_overlap) {
+		ehdr.e_shoff = (end + 7) & ~size_t(7);
+	}
+}
+
+void elf_symbol_index::clear()
+{
+	ranges.clear();
+	max_end.clear();
+	eytz.clear();
+	eytz_rank.clear();
+}
+
+static size_t elf_symbol_index_fill(elf_symbol_index &index, size_t rank, size_t k)
+{
+	if (k >= index.eytz.size()) return rank;
+	rank = elf_symbol_index_fill(index, rank, 2 * k);
+	index.eytz[k] = index.ranges[rank].start;
+	index.eytz_rank[k] = uint32_t(rank);
+	return elf_symbol_index_fill(index, rank + 1, 2 * k + 1);
+}
+
+void elf_symbol_index::build(const std::vector<Elf64_Sym> &symbols, const std::vector<size_t> &indices)
+{
+	clear();
+
+	// sort by address; the stable sort keeps symbol table order within an address
+	ranges.reserve(indices.size());
+	for (size_t i : indices) {
+		ranges.push_back(elf_symbol_range{ symbols[i].st_value, symbols[i].st_value + symbols[i].st_size, i, i });
+	}
+	std::stable_sort(ranges.begin(), ranges.end(), [](const elf_symbol_range &a, const elf_symbol_range &b) {
+		return a.start < b.start;
+	});
+
+	// merge symbols sharing an address
+	size_t n = 0;
+	for (size_t i = 0; i < ranges.size(); i++) {
+		if (n > 0 && ranges[n - 1].start == ranges[i].start) {
+			if (ranges[i].end >= ranges[n - 1].end) {
+				ranges[n - 1].end = ranges[i].end;
+				ranges[n - 1].extent_sym = ranges[i].sym;
+			}
+			ranges[n - 1].sym = ranges[i].sym;
+		} else {
+			ranges[n++] = ranges[i];
+		}
+	}
+	ranges.resize(n);
+
+	max_end.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		max_end[i] = std::max(i > 0 ? max_end[i - 1] : 0, ranges[i].end);
+	}
+
+	// slot 0 is unused so the children of k are 2k and 2k+1
+	eytz.resize(n + 1);
+	eytz_rank.resize(n + 1);
+	elf_symbol_index_fill(*this, 0, 1);
+}
+
+size_t elf_symbol_index::lower_bound(Elf64_Addr addr) const
+{
+	size_t n = ranges.size(), k = 1;
+	while (k <= n) {
+		k = 2 * k + (eytz[k] < addr);
+	}
+	// strip the trailing right turns to get the last node we went left at
+	k >>= __builtin_ffsll(~(long long)k);
+	return k ? eytz_rank[k] : n;
+}
+
+void elf_symbol_index::lower_bound(const Elf64_Addr *addrs, size_t count, size_t *ranks) const
+{
+	// walk eight searches in lockstep so their cache misses overlap
+	const size_t lanes = 8;
+	size_t n = ranges.size();
+	for (size_t base = 0; base < count; base += lanes) {
+		size_t m = std::min(count - base, lanes);
+		size_t k[lanes];
+		for (size_t j = 0; j < m; j++) k[j] = 1;
+		for (bool active = n > 0; active; ) {
+			active = false;
+			for (size_t j = 0; j < m; j++) {
+				if (k[j] > n) continue;
+				k[j] = 2 * k[j] + (eytz[k[j]] < addrs[base + j]);
+				if (k[j] <= n) {
+					__builtin_prefetch(&eytz[k[j]]);
+					active = true;
+				}
+			}
+		}
+		for (size_t j = 0; j < m; j++) {
+			size_t kj = k[j] >> __builtin_ffsll(~(long long)k[j]);
+			ranks[base + j] = kj ? eytz_rank[kj] : n;
+		}
+	}
+}
+
+const elf_symbol_range* elf_symbol_index::find(Elf64_Addr addr, size_t rank) const
+{
+	return rank < ranges.size() && ranges[rank].start == addr ? &ranges[rank] : nullptr;
+}
+
+const elf_symbol_range* elf_symbol_index::nearest(Elf64_Addr addr, size_t rank) const
+{
+	// the symbol at or below addr, else the first symbol above it; none past the last symbol
+	if (rank == ranges.size()) return nullptr;
+	if (ranges[rank].start == addr || rank == 0) return &ranges[rank];
+	return &ranges[rank - 1];
+}
+
+const elf_symbol_range* elf_symbol_index::containing(Elf64_Addr addr, size_t rank) const
+{
+	// i counts the ranges starting at or below addr
+	size_t i = rank < ranges.size() && ranges[rank].start == addr ? rank + 1 : rank;
+	while (i > 0 && max_end[i - 1] > addr) {
+		i--;
+		if (ranges[i].end > addr) return &ranges[i];
+	}
+	return nullptr;
+}
+
+uint64_t elf_symbol_name_index::hash(const char *name, size_t len)
+{
+	// FNV-1a, finished with a multiply-xorshift so the low bits used for the slot are well mixed
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ uint8_t(name[i])) * 0x100000001b3ULL;
+	}
+	h = (h ^ (h >> 32)) * 0xbf58476d1ce4e5b9ULL;
+	return h ^ (h >> 29);
+}
+
+void elf_symbol_name_index::clear()
+{
+	slots.clear();
+	mask = 0;
+}
+
+void elf_symbol_name_index::build(const std::vector<std::pair<const char*,size_t>> &names)
+{
+	size_t num_slots = 16;
+	while (num_slots < names.size() * 2) num_slots <<= 1;
+	slots.assign(num_slots, elf_symbol_name_slot{ 0, nullptr, 0, 0 });
+	mask = num_slots - 1;
+
+	for (auto &ent : names) {
+		size_t len = strlen(ent.first);
+		uint64_t h = hash(ent.first, len);
+		size_t i = h & mask;
+		while (slots[i].name && !(slots[i].hash == h && slots[i].len == len &&
+			memcmp(slots[i].name, ent.first, len) == 0)) {
+			i = (i + 1) & mask;
+		}
+		slots[i] = elf_symbol_name_slot{ h, ent.first, uint32_t(len), uint32_t(ent.second) };
+	}
+}
+
+size_t elf_symbol_name_index::find(const char *name, size_t len, uint64_t h) const
+{
+	if (slots.empty()) return npos;
+	for (size_t i = h & mask; slots[i].name; i = (i + 1) & mask) {
+		if (slots[i].hash == h && slots[i].len == len && memcmp(slots[i].name, name, len) == 0) {
+			return slots[i].sym;
+		}
+	}
+	return npos;
+}
+
+void elf_symbol_name_index::find(const char *const *names, size_t count, size_t *syms) const
+{
+	// hash every name and prefetch its home slot before probing any of them
+	uint64_t hashes[64];
+	size_t lens[64];
+	for (size_t base = 0; base < count; base += 64) {
+		size_t n = std::min(count - base, size_t(64));
+		for (size_t i = 0; i < n; i++) {
+			lens[i] = strlen(names[base + i]);
+			hashes[i] = hash(names[base + i], lens[i]);
+			if (!slots.empty()) __builtin_prefetch(&slots[hashes[i] & mask]);
+		}
+		for (size_t i = 0; i < n; i++) {
+			syms[base + i] = find(names[base + i], lens[i], hashes[i]);
+		}
+	}
 }
 
 uint8_t* elf_file::offset(size_t offset)
 {
 	for (size_t i = 0; i < sections.size(); i++) {
-		if (offset >= sections[i].offset && offset < sections[i].offset + sections[i].buf.size()) {
-			return sections[i].buf.data() + (offset - sections[i].offset);
+		if (offset >= sections[i].offset && offset < sections[i].offset + sections[i].length()) {
+			materialize(i);
+			return sections[i].data() + (offset - sections[i].offset);
 		}
 	}
 	panic("illegal offset: %lu", offset);
@@ -394,7 +974,8 @@ uint8_t* elf_file::offset(size_t offset)
 elf_section* elf_file::section(size_t offset)
 {
 	for (size_t i = 0; i < sections.size(); i++) {
-		if (offset >= sections[i].offset && offset < sections[i].offset + sections[i].buf.size()) {
+		if (offset >= sections[i].offset && offset < sections[i].offset + sections[i].length()) {
+			materialize(i);
 			return &sections[i];
 		}
 	}
@@ -421,23 +1002,77 @@ const char* elf_file::sym_name(const Elf64_Sym *sym)
 
 const Elf64_Sym* elf_file::sym_by_nearest_addr(Elf64_Addr addr)
 {
-	auto ai = addr_symbol_map.lower_bound(addr);
-	if (ai == addr_symbol_map.end()) return nullptr;
-	if (ai->second == addr) return &symbols[ai->second];
-	if (ai != addr_symbol_map.begin()) ai--;
-	return &symbols[ai->second];
+	auto r = addr_symbol_index.nearest(addr, addr_symbol_index.lower_bound(addr));
+	return r ? &symbols[r->sym] : nullptr;
 }
 
 const Elf64_Sym* elf_file::sym_by_addr(Elf64_Addr addr)
 {
-	auto ai = addr_symbol_map.find(addr);
-	if (ai == addr_symbol_map.end()) return nullptr;
-	return &symbols[ai->second];
+	auto r = addr_symbol_index.find(addr, addr_symbol_index.lower_bound(addr));
+	return r ? &symbols[r->sym] : nullptr;
+}
+
+const Elf64_Sym* elf_file::sym_by_containing_addr(Elf64_Addr addr)
+{
+	auto r = addr_symbol_index.containing(addr, addr_symbol_index.lower_bound(addr));
+	return r ? &symbols[r->extent_sym] : nullptr;
+}
+
+template <typename F>
+static void elf_sym_batch(elf_file &elf, const Elf64_Addr *addrs, size_t count, const Elf64_Sym **syms,
+	size_t elf_symbol_range::*sym, F lookup)
+{
+	size_t ranks[64];
+	for (size_t base = 0; base < count; base += 64) {
+		size_t n = std::min(count - base, size_t(64));
+		elf.addr_symbol_index.lower_bound(addrs + base, n, ranks);
+		for (size_t i = 0; i < n; i++) {
+			auto r = lookup(addrs[base + i], ranks[i]);
+			syms[base + i] = r ? &elf.symbols[r->*sym] : nullptr;
+		}
+	}
+}
+
+void elf_file::sym_by_nearest_addr(const Elf64_Addr *addrs, size_t count, const Elf64_Sym **syms)
+{
+	elf_sym_batch(*this, addrs, count, syms, &elf_symbol_range::sym, [&](Elf64_Addr addr, size_t rank) {
+		return addr_symbol_index.nearest(addr, rank);
+	});
+}
+
+void elf_file::sym_by_addr(const Elf64_Addr *addrs, size_t count, const Elf64_Sym **syms)
+{
+	elf_sym_batch(*this, addrs, count, syms, &elf_symbol_range::sym, [&](Elf64_Addr addr, size_t rank) {
+		return addr_symbol_index.find(addr, rank);
+	});
+}
+
+void elf_file::sym_by_containing_addr(const Elf64_Addr *addrs, size_t count, const Elf64_Sym **syms)
+{
+	elf_sym_batch(*this, addrs, count, syms, &elf_symbol_range::extent_sym, [&](Elf64_Addr addr, size_t rank) {
+		return addr_symbol_index.containing(addr, rank);
+	});
 }
 
 const Elf64_Sym* elf_file::sym_by_name(const char *name)
 {
-	size_t i = name_symbol_map[name];
-	if (i == 0 || i >= symbols.size()) return nullptr;
-	return &symbols[i];
+	return sym_by_name(name, strlen(name));
+}
+
+const Elf64_Sym* elf_file::sym_by_name(const char *name, size_t len)
+{
+	size_t i = name_symbol_index.find(name, len);
+	return i == elf_symbol_name_index::npos ? nullptr : &symbols[i];
+}
+
+void elf_file::sym_by_name(const char *const *names, size_t count, const Elf64_Sym **syms)
+{
+	size_t indices[64];
+	for (size_t base = 0; base < count; base += 64) {
+		size_t n = std::min(count - base, size_t(64));
+		name_symbol_index.find(names + base, n, indices);
+		for (size_t i = 0; i < n; i++) {
+			syms[base + i] = indices[i] == elf_symbol_name_index::npos ? nullptr : &symbols[indices[i]];
+		}
+	}
 }
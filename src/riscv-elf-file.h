@@ -5,8 +5,31 @@
 #ifndef riscv_elf_file_h
 #define riscv_elf_file_h
 
-struct cmp_str {
-	bool operator()(char const *a, char const *b) const { return std::strcmp(a, b) < 0; }
+/*
+ * Section bytes are either owned by buf (load) or a view into the file
+ * mapping (load_mmap); data() and length() work for both. A section of a
+ * load_lazy file is not loaded until elf_file::section(), offset() or
+ * materialize() first touches it; length() reports its full size before
+ * then, so offset lookups still find it. save() copies views and sections
+ * never loaded straight from the input file, so code that writes through
+ * a view must set dirty.
+ *
+ * Loading a lazy section writes its elf_section without locking, so a
+ * load_lazy elf_file must only be used from one thread at a time. Threads
+ * may share one loaded with load or load_mmap, or a lazy one whose
+ * sections have all been materialized, as long as none of them modifies it.
+ *
+ * The loaders panic on a file they cannot read or parse, except
+ * load_mmap(filename, error), which clears the elf_file, sets error and
+ * returns false instead, so tools that walk many files can skip a bad one.
+ * It checks the header tables and sections against the file size, the
+ * symbol table entry size and that every symbol name is terminated inside
+ * the string table.
+ */
+
+enum elf_load_mode {
+	elf_load_eager,
+	elf_load_lazy
 };
 
 struct elf_section
@@ -14,6 +37,84 @@ struct elf_section
 	size_t offset;
 	size_t size;
 	std::vector<uint8_t> buf;
+	uint8_t *view;
+	bool loaded;
+	bool dirty;
+
+	uint8_t* data() { return view ? view : buf.data(); }
+	size_t length() const { return view || !loaded ? size : buf.size(); }
+};
+
+/*
+ * Address index over the symbol table: one range per distinct symbol
+ * address, sorted by start, with the starts also kept in Eytzinger (BFS)
+ * order so a search walks down an implicit tree whose top levels share a
+ * few cache lines. Where several symbols share an address the last one in
+ * the symbol table names the range (sym, for exact and nearest lookups)
+ * and the one with the largest st_size bounds it (extent_sym, for
+ * containment), so a zero-size label never contains an address. max_end
+ * holds the running maximum of end so containment queries can step back
+ * over ranges that end before the address.
+ */
+
+struct elf_symbol_range
+{
+	Elf64_Addr start;
+	Elf64_Addr end;
+	size_t sym;
+	size_t extent_sym;
+};
+
+struct elf_symbol_index
+{
+	std::vector<elf_symbol_range> ranges;
+	std::vector<Elf64_Addr> max_end;
+	std::vector<Elf64_Addr> eytz;
+	std::vector<uint32_t> eytz_rank;
+
+	void clear();
+	void build(const std::vector<Elf64_Sym> &symbols, const std::vector<size_t> &indices);
+
+	size_t size() const { return ranges.size(); }
+	size_t lower_bound(Elf64_Addr addr) const;
+	void lower_bound(const Elf64_Addr *addrs, size_t count, size_t *ranks) const;
+
+	const elf_symbol_range* find(Elf64_Addr addr, size_t rank) const;
+	const elf_symbol_range* nearest(Elf64_Addr addr, size_t rank) const;
+	const elf_symbol_range* containing(Elf64_Addr addr, size_t rank) const;
+};
+
+/*
+ * Name index over the symbol table: an open-addressing hash table with
+ * linear probing, at most half full. Keys are pointer and length pairs
+ * into the string table, so nothing is copied; each slot carries the full
+ * hash so most mismatches are rejected without touching the name. Where
+ * several symbols share a name the last one in the symbol table wins.
+ */
+
+struct elf_symbol_name_slot
+{
+	uint64_t hash;
+	const char *name;
+	uint32_t len;
+	uint32_t sym;
+};
+
+struct elf_symbol_name_index
+{
+	enum : size_t { npos = size_t(-1) };
+
+	std::vector<elf_symbol_name_slot> slots;
+	size_t mask;
+
+	static uint64_t hash(const char *name, size_t len);
+
+	void clear();
+	void build(const std::vector<std::pair<const char*,size_t>> &names);
+
+	size_t find(const char *name, size_t len, uint64_t h) const;
+	size_t find(const char *name, size_t len) const { return find(name, len, hash(name, len)); }
+	void find(const char *const *names, size_t count, size_t *syms) const;
 };
 
 struct elf_file
@@ -27,20 +128,33 @@ struct elf_file
 	std::vector<Elf64_Phdr> phdrs;
 	std::vector<Elf64_Shdr> shdrs;
 	std::vector<Elf64_Sym> symbols;
-	std::map<Elf64_Addr,size_t> addr_symbol_map;
-	std::map<const char*,size_t,cmp_str> name_symbol_map;
+	elf_symbol_index addr_symbol_index;
+	elf_symbol_name_index name_symbol_index;
 	Elf64_Shdr *shstrtab;
 	Elf64_Shdr *symtab;
 	Elf64_Shdr *strtab;
 	std::vector<elf_section> sections;
+	uint8_t *map;
+	size_t map_size;
+	int map_fd;
+	FILE *lazy_file;
 
 	elf_file();
 	elf_file(std::string filename);
+	elf_file(const elf_file&) = delete;
+	elf_file& operator=(const elf_file&) = delete;
+	~elf_file();
 
 	void clear();
 	void load(std::string filename);
+	void load_lazy(std::string filename);
+	void load_file(std::string filename, elf_load_mode mode);
+	void load_mmap(std::string filename);
+	bool load_mmap(std::string filename, std::string &error);
+	void materialize(size_t i);
 	void save(std::string filename);
 
+	void find_symbol_tables();
 	void byteswap_symbol_table(ELFENDIAN endian);
 	void copy_from_symbol_table_sections();
 	void copy_to_symbol_table_sections();
@@ -54,7 +168,13 @@ struct elf_file
 	const char* sym_name(const Elf64_Sym *sym);
 	const Elf64_Sym* sym_by_nearest_addr(Elf64_Addr addr);
 	const Elf64_Sym* sym_by_addr(Elf64_Addr addr);
+	const Elf64_Sym* sym_by_containing_addr(Elf64_Addr addr);
+	void sym_by_nearest_addr(const Elf64_Addr *addrs, size_t count, const Elf64_Sym **syms);
+	void sym_by_addr(const Elf64_Addr *addrs, size_t count, const Elf64_Sym **syms);
+	void sym_by_containing_addr(const Elf64_Addr *addrs, size_t count, const Elf64_Sym **syms);
 	const Elf64_Sym* sym_by_name(const char *name);
+	const Elf64_Sym* sym_by_name(const char *name, size_t len);
+	void sym_by_name(const char *const *names, size_t count, const Elf64_Sym **syms);
 };
 
 #endif
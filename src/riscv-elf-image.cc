@@ -0,0 +1,125 @@
+//
+//  riscv-elf-image.cc
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-elf.h"
+#include "riscv-elf-file.h"
+#include "riscv-elf-image.h"
+#include "riscv-util.h"
+
+struct elf_image_segment
+{
+	Elf64_Addr addr;
+	size_t file_offset;
+	size_t file_size;
+	size_t mem_size;
+};
+
+void elf_image::clear()
+{
+	arena.clear();
+	page_table.clear();
+	base = 0;
+	page_shift = 12;
+}
+
+/* Copies file bytes [offset, offset + size) into dst from the mapping or the loaded sections */
+static void elf_image_copy(elf_file &elf, uint8_t *dst, size_t offset, size_t size)
+{
+	if (elf.map) {
+		if (offset > elf.map_size || size > elf.map_size - offset) {
+			panic("error segment extends past end of file: %s", elf.filename.c_str());
+		}
+		memcpy(dst, elf.map + offset, size);
+		return;
+	}
+	// bytes no section covers, such as padding, stay zero
+	for (size_t i = 0; i < elf.sections.size(); i++) {
+		elf_section &sec = elf.sections[i];
+		if (elf.shdrs[i].sh_type == SHT_NOBITS) continue;
+		size_t begin = std::max(offset, sec.offset);
+		size_t end = std::min(offset + size, sec.offset + sec.length());
+		if (begin >= end) continue;
+		elf.materialize(i);
+		memcpy(dst + (begin - offset), sec.data() + (begin - sec.offset), end - begin);
+	}
+}
+
+void elf_image::load(elf_file &elf, bool physical)
+{
+	clear();
+
+	std::vector<elf_image_segment> segments;
+	for (auto &phdr : elf.phdrs) {
+		if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0) continue;
+		segments.push_back(elf_image_segment{ physical ? phdr.p_paddr : phdr.p_vaddr,
+			phdr.p_offset, std::min(phdr.p_filesz, phdr.p_memsz), phdr.p_memsz });
+	}
+	if (segments.empty()) return;
+	std::sort(segments.begin(), segments.end(), [](const elf_image_segment &a, const elf_image_segment &b) {
+		return a.addr < b.addr;
+	});
+
+	// grow the page size until the table over the whole span is small enough
+	Elf64_Addr lo = segments.front().addr, hi = 0;
+	for (auto &seg : segments) hi = std::max(hi, seg.addr + seg.mem_size);
+	while (((hi - lo) >> page_shift) >= riscv_elf_image_max_pages) page_shift++;
+	Elf64_Addr page_size = Elf64_Addr(1) << page_shift;
+	base = lo & ~(page_size - 1);
+	page_table.assign(((hi - base) + page_size - 1) >> page_shift, nullptr);
+
+	// group segments whose pages touch into runs, then size the arena
+	struct run { Elf64_Addr begin, end; size_t arena_offset; };
+	std::vector<run> runs;
+	std::vector<size_t> segment_run(segments.size());
+	for (size_t i = 0; i < segments.size(); i++) {
+		Elf64_Addr begin = segments[i].addr & ~(page_size - 1);
+		Elf64_Addr end = (segments[i].addr + segments[i].mem_size + page_size - 1) & ~(page_size - 1);
+		if (runs.empty() || begin > runs.back().end) {
+			size_t arena_offset = runs.empty() ? 0 : runs.back().arena_offset + (runs.back().end - runs.back().begin);
+			runs.push_back(run{ begin, end, arena_offset });
+		} else {
+			runs.back().end = std::max(runs.back().end, end);
+		}
+		segment_run[i] = runs.size() - 1;
+	}
+	arena.assign(runs.back().arena_offset + (runs.back().end - runs.back().begin), 0);
+
+	for (auto &r : runs) {
+		for (Elf64_Addr page = r.begin; page < r.end; page += page_size) {
+			page_table[(page - base) >> page_shift] = arena.data() + r.arena_offset + (page - r.begin);
+		}
+	}
+	for (size_t i = 0; i < segments.size(); i++) {
+		const run &r = runs[segment_run[i]];
+		uint8_t *dst = arena.data() + r.arena_offset + (segments[i].addr - r.begin);
+		elf_image_copy(elf, dst, segments[i].file_offset, segments[i].file_size);
+	}
+}
+
+bool elf_image::get_instruction(Elf64_Addr pc, riscv_lu *inst, Elf64_Addr *next_pc) const
+{
+	uint8_t *host = translate(pc, 2);
+	if (!host) return false;
+	uint16_t parcel;
+	memcpy(&parcel, host, sizeof(parcel));
+	size_t length = riscv_get_instruction_length(htole16(parcel));
+	if (!translate(pc, length)) return false;
+	*inst = riscv_get_instruction(riscv_ptr(host));
+	if (next_pc) *next_pc = pc + length;
+	return true;
+}
@@ -0,0 +1,65 @@
+//
+//  riscv-elf-image.h
+//
+
+#ifndef riscv_elf_image_h
+#define riscv_elf_image_h
+
+/*
+ * ELF Memory Image
+ *
+ * Guest memory of an elf_file laid out from its PT_LOAD segments. Segments
+ * whose pages touch are placed in one contiguous run of the arena, with the
+ * bytes between them and the p_memsz tail zero filled, so any two adjacent
+ * mapped guest pages are adjacent in host memory too. A flat page table
+ * over the span of the segments holds the host address of every mapped
+ * page (nullptr otherwise), so translation is one shift and one load.
+ * Mapping is page granular, as under an MMU: the rest of a segment's last
+ * page reads as zero.
+ *
+ * The page size starts at 4 KiB and doubles until the table has at most
+ * riscv_elf_image_max_pages entries, which keeps it small for images whose
+ * segments are far apart.
+ */
+
+enum { riscv_elf_image_max_pages = 1 << 20 };
+
+struct elf_image
+{
+	std::vector<uint8_t> arena;
+	std::vector<uint8_t*> page_table;
+	Elf64_Addr base;
+	unsigned page_shift;
+
+	elf_image() : base(0), page_shift(12) {}
+
+	/* Loads the PT_LOAD segments at p_vaddr, or at p_paddr if physical is set */
+	void load(elf_file &elf, bool physical = false);
+	void clear();
+
+	/* Host address of guest address addr, or nullptr if it is not mapped */
+	inline uint8_t* translate(Elf64_Addr addr) const
+	{
+		Elf64_Addr page = (addr - base) >> page_shift;
+		if (addr < base || page >= page_table.size() || !page_table[page]) return nullptr;
+		return page_table[page] + ((addr - base) & ((Elf64_Addr(1) << page_shift) - 1));
+	}
+
+	/* Host address of [addr, addr + len) if all of it is mapped, else nullptr */
+	inline uint8_t* translate(Elf64_Addr addr, size_t len) const
+	{
+		uint8_t *first = translate(addr);
+		if (!first || len == 0) return first;
+		uint8_t *last = translate(addr + len - 1);
+		return last == first + len - 1 ? first : nullptr;
+	}
+
+	/*
+	 * riscv_get_instruction() on a guest pc: reads the parcel at pc into inst
+	 * and sets next_pc to the guest address after it. Returns false, leaving
+	 * both untouched, if any byte of the parcel is not mapped.
+	 */
+	bool get_instruction(Elf64_Addr pc, riscv_lu *inst, Elf64_Addr *next_pc = nullptr) const;
+};
+
+#endif
@@ -0,0 +1,116 @@
+//
+//  riscv-profile.cc
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+#include "riscv-types.h"
+#include "riscv-endian.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-imm.h"
+#include "riscv-decode.h"
+#include "riscv-decode-table.h"
+#include "riscv-profile.h"
+
+template <typename P>
+static void riscv_profile_decode_opcode(riscv_decode &dec, riscv_lu inst)
+{
+	riscv_decode_opcode<riscv_decode,P>(dec, inst);
+}
+
+template <typename P>
+static void riscv_profile_decode_instruction(riscv_decode &dec, riscv_lu inst)
+{
+	riscv_decode_instruction<riscv_decode,P>(dec, inst);
+}
+
+template <typename P>
+static void riscv_profile_decode_ops(const riscv_wu *inst, size_t count, riscv_hu *op)
+{
+	for (size_t i = 0; i < count; i++) {
+		riscv_decode dec;
+		riscv_decode_opcode_table<riscv_decode,P>(dec, inst[i]);
+		op[i] = dec.op;
+	}
+}
+
+#define RISCV_PROFILE_DECODER(name) \
+	{ #name, riscv_profile_##name::isa, \
+	  riscv_profile_decode_opcode<riscv_profile_##name>, \
+	  riscv_profile_decode_instruction<riscv_profile_##name>, \
+	  riscv_profile_decode_ops<riscv_profile_##name> }
+
+const riscv_profile_decoder riscv_profile_decoders[] = {
+	RISCV_PROFILE_DECODER(rv32i),
+	RISCV_PROFILE_DECODER(rv32imac),
+	RISCV_PROFILE_DECODER(rv32g),
+	RISCV_PROFILE_DECODER(rv32gc),
+	RISCV_PROFILE_DECODER(rv64i),
+	RISCV_PROFILE_DECODER(rv64imac),
+	RISCV_PROFILE_DECODER(rv64g),
+	RISCV_PROFILE_DECODER(rv64gc),
+	{ nullptr, 0, nullptr, nullptr, nullptr }
+};
+
+riscv_hu riscv_profile_parse_isa(std::string isa_spec)
+{
+	// canonicalise isa spec to lower case
+	std::transform(isa_spec.begin(), isa_spec.end(), isa_spec.begin(), ::tolower);
+
+	// find isa prefix and width
+	riscv_hu isa;
+	if (isa_spec.find("rv32") == 0) {
+		isa = riscv_isa_rv32;
+	} else if (isa_spec.find("rv64") == 0) {
+		isa = riscv_isa_rv64;
+	} else {
+		return 0;
+	}
+
+	// replace 'g' with 'imafd'
+	size_t g_offset = isa_spec.find("g");
+	if (g_offset != std::string::npos) {
+		isa_spec = isa_spec.replace(isa_spec.begin() + g_offset,
+			isa_spec.begin() + g_offset + 1, "imafd");
+	}
+
+	// lookup extensions, privileged opcodes are always on
+	isa |= riscv_isa_rvs;
+	for (auto i = isa_spec.begin() + 4; i != isa_spec.end(); i++) {
+		switch (*i) {
+			case 'i': isa |= riscv_isa_rvi; break;
+			case 'm': isa |= riscv_isa_rvm; break;
+			case 'a': isa |= riscv_isa_rva; break;
+			case 's': isa |= riscv_isa_rvs; break;
+			case 'f': isa |= riscv_isa_rvf; break;
+			case 'd': isa |= riscv_isa_rvd; break;
+			case 'c': isa |= riscv_isa_rvc; break;
+			default: return 0;
+		}
+	}
+	return (isa & riscv_isa_rvi) ? isa : 0;
+}
+
+const riscv_profile_decoder* riscv_profile_select(std::string isa_spec)
+{
+	riscv_hu isa = riscv_profile_parse_isa(isa_spec);
+	for (const riscv_profile_decoder *d = riscv_profile_decoders; isa && d->name; d++) {
+		if (d->isa == isa) return d;
+	}
+	return nullptr;
+}
+
+std::string riscv_profile_names()
+{
+	std::string names;
+	for (const riscv_profile_decoder *d = riscv_profile_decoders; d->name; d++) {
+		if (names.size() > 0) names += ", ";
+		names += d->name;
+	}
+	return names;
+}
@@ -0,0 +1,94 @@
+//
+//  riscv-profile.h
+//
+
+#ifndef riscv_profile_h
+#define riscv_profile_h
+
+/*
+ * ISA Profiles
+ *
+ * Name the nine ISA subset flags of riscv_decode_opcode once, so callers
+ * write riscv_decode_opcode<T,riscv_profile_rv64g>(dec, inst) instead of a
+ * row of bools. Privileged opcodes (rvs) are enabled in every profile, as
+ * they are in the riscv_decode_opcode defaults.
+ */
+
+template <bool rv32_, bool rv64_, bool rvi_, bool rvm_, bool rva_, bool rvs_, bool rvf_, bool rvd_, bool rvc_>
+struct riscv_isa_profile
+{
+	static constexpr bool rv32 = rv32_;
+	static constexpr bool rv64 = rv64_;
+	static constexpr bool rvi = rvi_;
+	static constexpr bool rvm = rvm_;
+	static constexpr bool rva = rva_;
+	static constexpr bool rvs = rvs_;
+	static constexpr bool rvf = rvf_;
+	static constexpr bool rvd = rvd_;
+	static constexpr bool rvc = rvc_;
+	static constexpr riscv_hu isa = riscv_isa_flags<rv32_,rv64_,rvi_,rvm_,rva_,rvs_,rvf_,rvd_,rvc_>();
+};
+
+/*                                        rv32   rv64   rvi   rvm    rva    rvs   rvf    rvd    rvc */
+typedef riscv_isa_profile<true,  false, true, false, false, true, false, false, false> riscv_profile_rv32i;
+typedef riscv_isa_profile<true,  false, true, true,  true,  true, false, false, true>  riscv_profile_rv32imac;
+typedef riscv_isa_profile<true,  false, true, true,  true,  true, true,  true,  false> riscv_profile_rv32g;
+typedef riscv_isa_profile<true,  false, true, true,  true,  true, true,  true,  true>  riscv_profile_rv32gc;
+typedef riscv_isa_profile<false, true,  true, false, false, true, false, false, false> riscv_profile_rv64i;
+typedef riscv_isa_profile<false, true,  true, true,  true,  true, false, false, true>  riscv_profile_rv64imac;
+typedef riscv_isa_profile<false, true,  true, true,  true,  true, true,  true,  false> riscv_profile_rv64g;
+typedef riscv_isa_profile<false, true,  true, true,  true,  true, true,  true,  true>  riscv_profile_rv64gc;
+
+/* Decode with a profile */
+
+template <typename T, typename P>
+inline void riscv_decode_opcode(T &dec, riscv_lu inst)
+{
+	riscv_decode_opcode<T,P::rv32,P::rv64,P::rvi,P::rvm,P::rva,P::rvs,P::rvf,P::rvd,P::rvc>(dec, inst);
+}
+
+template <typename T, typename P>
+inline void riscv_decode_opcode_table(T &dec, riscv_lu inst)
+{
+	riscv_decode_opcode_table<T,P::rv32,P::rv64,P::rvi,P::rvm,P::rva,P::rvs,P::rvf,P::rvd,P::rvc>(dec, inst);
+}
+
+template <typename T, typename P>
+inline void riscv_decode_instruction(T &dec, riscv_lu inst)
+{
+	riscv_decode_instruction<T,P::rv32,P::rv64,P::rvi,P::rvm,P::rva,P::rvs,P::rvf,P::rvd,P::rvc>(dec, inst);
+}
+
+/*
+ * Pre-instantiated Decoders
+ *
+ * One entry per profile above. decode_ops writes the op of each word using
+ * the table backend, riscv_op_unknown for illegal words.
+ */
+
+struct riscv_profile_decoder
+{
+	const char* name;
+	riscv_hu isa;
+	void (*decode_opcode)(riscv_decode &dec, riscv_lu inst);
+	void (*decode_instruction)(riscv_decode &dec, riscv_lu inst);
+	void (*decode_ops)(const riscv_wu *inst, size_t count, riscv_hu *op);
+};
+
+extern const riscv_profile_decoder riscv_profile_decoders[];
+
+/*
+ * Parse an ISA string such as "RV64IMAFDC" or "rv32g" into riscv_isa_flags,
+ * the same way riscv_meta_model::decode_isa_extensions reads it: case is
+ * ignored, the width follows the "rv" prefix and 'g' stands for "imafd".
+ * Returns 0 if the string is not a valid ISA.
+ */
+riscv_hu riscv_profile_parse_isa(std::string isa_spec);
+
+/* Select the decoder for an ISA string, or nullptr if no profile matches exactly */
+const riscv_profile_decoder* riscv_profile_select(std::string isa_spec);
+
+/* Comma separated list of the profile names */
+std::string riscv_profile_names();
+
+#endif